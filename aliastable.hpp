@@ -0,0 +1,133 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#pragma once
+#ifndef aliastable_hpp
+#define aliastable_hpp
+
+#include <vector>
+
+#include "attenuationexception.hpp"
+
+//
+// Sampling of an index with probability proportional to a set of weights in constant time
+// using Walker's alias method (with Vose's construction). Each of the n columns holds the
+// probability of keeping its own index, otherwise its alias is returned, so that a single
+// uniform selects both the column (its integer part when scaled by n) and whether to take
+// the alias (its fractional part).
+//
+class aliastable {
+public:
+
+  aliastable()
+  {
+  }
+
+  void build(const std::vector<double> &weights)
+  {
+    int n = (int)weights.size();
+    if (n == 0) {
+      throw ATTENUATIONEXCEPTION("Empty alias table\n");
+    }
+
+    double sum = 0.0;
+    for (auto w : weights) {
+      if (w <= 0.0) {
+	throw ATTENUATIONEXCEPTION("Invalid weight: %f\n", w);
+      }
+      sum += w;
+    }
+
+    keep.resize(n);
+    alias.resize(n);
+
+    std::vector<int> small;
+    std::vector<int> large;
+    for (int i = 0; i < n; i ++) {
+      keep[i] = weights[i] * (double)n/sum;
+      alias[i] = i;
+      
+      if (keep[i] < 1.0) {
+	small.push_back(i);
+      } else {
+	large.push_back(i);
+      }
+    }
+
+    while (!small.empty() && !large.empty()) {
+      int s = small.back();
+      small.pop_back();
+      int l = large.back();
+
+      alias[s] = l;
+      keep[l] -= 1.0 - keep[s];
+
+      if (keep[l] < 1.0) {
+	large.pop_back();
+	small.push_back(l);
+      }
+    }
+
+    //
+    // Whatever remains is within rounding of 1
+    //
+    for (auto i : small) {
+      keep[i] = 1.0;
+    }
+    for (auto i : large) {
+      keep[i] = 1.0;
+    }
+  }
+
+  int size() const
+  {
+    return (int)keep.size();
+  }
+
+  //
+  // u uniform on [0, 1)
+  //
+  int sample(double u) const
+  {
+    double x = u * (double)keep.size();
+    int i = (int)x;
+    if (i >= (int)keep.size()) {
+      i = keep.size() - 1;
+    }
+
+    if ((x - (double)i) < keep[i]) {
+      return i;
+    } else {
+      return alias[i];
+    }
+  }
+
+private:
+
+  std::vector<double> keep;
+  std::vector<int> alias;
+  
+};
+
+#endif // aliastable_hpp
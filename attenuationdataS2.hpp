@@ -26,8 +26,11 @@
 #ifndef attenuationdataS2_hpp
 #define attenuationdataS2_hpp
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include "coordinate.hpp"
@@ -99,6 +102,19 @@ public:
     }
   }
 
+  //
+  // Cartesian positions of the points used by the exact forward model and point location
+  //
+  void compute_cartesian()
+  {
+    cartesian.resize(points.size());
+    
+    for (size_t i = 0; i < points.size(); i ++) {
+      coord_t::sphericaltocartesian(points[i].phi, points[i].theta, cartesian[i]);
+      cartesian[i] *= points[i].r;
+    }
+  }
+
   double compute_mean_Q()
   {
     double tt = 0.0;
@@ -109,12 +125,18 @@ public:
     return tt/tstar;
   }
 
-  value predicted_tstar_direct(const sphericalvoronoimodel<value> &model)
+  //
+  // Sum over the points of the path. The nearest cell of each point is located starting
+  // from cell, which is updated to the cell of the last point.
+  //
+  value predicted_tstar_direct(const sphericalvoronoimodel<value> &model, int &cell)
   {
     value tstar = 0.0;
-    for (auto &d : points) {
+    
+    for (size_t i = 0; i < points.size(); i ++) {
 
-      value Q = model.value_at_point(coord_t(d.phi, d.theta));
+      const dataS2<value> &d = points[i];
+      value Q = model.value_at_point(coord_t(d.phi, d.theta), cartesian[i], cell);
 
       tstar += d.distance/(Q * d.vp);
       
@@ -123,6 +145,162 @@ public:
     return tstar;
   }
 
+  //
+  // Predicted t* for several models in a single pass over the points of the path
+  //
+  void predicted_tstar_batch(int nmodels,
+			     const sphericalvoronoimodel<value> * const *models,
+			     value *tstar,
+			     int *cell)
+  {
+    for (int m = 0; m < nmodels; m ++) {
+      tstar[m] = 0.0;
+    }
+    
+    for (size_t i = 0; i < points.size(); i ++) {
+
+      const dataS2<value> &d = points[i];
+      coord_t p(d.phi, d.theta);
+      
+      for (int m = 0; m < nmodels; m ++) {
+	value Q = models[m]->value_at_point(p, cartesian[i], cell[m]);
+
+	tstar[m] += d.distance/(Q * d.vp);
+      }
+    }
+  }
+
+  //
+  // Exact forward model: each straight segment between consecutive points is walked
+  // through the spherical Voronoi tessellation. A point x lies on the bisector of cells i
+  // and j when x.(ci - cj) = 0 so the crossings are linear in the segment parameter and
+  // the length within each cell is exact. 1/vp is interpolated linearly along a segment
+  // and integrated analytically.
+  //
+  // A segment can only leave a cell into one of its natural neighbours so, given the
+  // neighbours of each cell in compressed rows (offsets/neighbours), only those are tested
+  // and the cell of the first point is found by a greedy walk from cell, which is updated
+  // to the cell of the last point. The cost then scales with the number of crossings. With
+  // no neighbours (the triangulation is unavailable) every cell is tested.
+  //
+  value predicted_tstar_exact(const std::vector<vector3<value>> &centres,
+			      const std::vector<value> &values,
+			      const std::vector<int> &offsets,
+			      const std::vector<int> &neighbours,
+			      int &cell) const
+  {
+    int ncells = centres.size();
+    bool walk = (offsets.size() == centres.size() + 1);
+    value tstar = 0.0;
+
+    if (cartesian.size() < 2) {
+      return tstar;
+    }
+
+    if (cell < 0 || cell >= ncells) {
+      cell = 0;
+    }
+
+    //
+    // Initial cell is the one with the closest centre in angle
+    //
+    if (walk) {
+      value maxdot = cartesian[0].dot(centres[cell]);
+      bool improved = true;
+      
+      while (improved) {
+	improved = false;
+	int next = cell;
+	
+	for (int k = offsets[cell]; k < offsets[cell + 1]; k ++) {
+	  int j = neighbours[k];
+	  value d = cartesian[0].dot(centres[j]);
+	  if (d > maxdot) {
+	    maxdot = d;
+	    next = j;
+	    improved = true;
+	  }
+	}
+
+	cell = next;
+      }
+    } else {
+      cell = 0;
+      value maxdot = cartesian[0].dot(centres[0]);
+      for (int j = 1; j < ncells; j ++) {
+	value d = cartesian[0].dot(centres[j]);
+	if (d > maxdot) {
+	  maxdot = d;
+	  cell = j;
+	}
+      }
+    }
+
+    for (size_t i = 1; i < cartesian.size(); i ++) {
+
+      const vector3<value> &a = cartesian[i - 1];
+      const vector3<value> &b = cartesian[i];
+      value length = (b - a).length();
+      value wa = 1.0/points[i - 1].vp;
+      value wb = 1.0/points[i].vp;
+
+      value t = 0.0;
+      int crossings = 0;
+      
+      while (true) {
+
+	value da = a.dot(centres[cell]);
+	value db = b.dot(centres[cell]);
+	value tnext = 1.0;
+	int next = -1;
+
+	int first = walk ? offsets[cell] : 0;
+	int last = walk ? offsets[cell + 1] : ncells;
+	
+	for (int k = first; k < last; k ++) {
+	  int j = walk ? neighbours[k] : k;
+	  if (j == cell) {
+	    continue;
+	  }
+
+	  value d1 = db - b.dot(centres[j]);
+	  if (d1 < 0.0) {
+	    value d0 = da - a.dot(centres[j]);
+	    value tc = 0.0;
+	    if (d0 > 0.0) {
+	      tc = d0/(d0 - d1);
+	    }
+
+	    if (tc < tnext) {
+	      tnext = tc;
+	      next = j;
+	    }
+	  }
+	}
+
+	if (tnext < t) {
+	  tnext = t;
+	}
+
+	tstar += length * (tnext - t) * (wa + (wb - wa) * (t + tnext)/2.0)/values[cell];
+
+	if (next < 0) {
+	  break;
+	}
+
+	cell = next;
+	t = tnext;
+
+	crossings ++;
+	if (crossings > 2 * ncells) {
+	  throw ATTENUATIONEXCEPTION("Failed to walk segment through tessellation\n");
+	}
+      }
+    }
+
+    return tstar;
+  }
+
   value predicted_tstar_synthetic(synthetic_model_f model)
   {
     value tstar = 0.0;
@@ -140,6 +318,7 @@ public:
   double tstar;
   double noise;
   std::vector<dataS2<value>> points;
+  std::vector<vector3<value>> cartesian;
 };
 
 template
@@ -155,7 +334,8 @@ public:
     Qmin(1e99),
     Qmax(-1e99),
     Qcount(0),
-    Qmean(0.0)
+    Qmean(0.0),
+    exact(false)
   {
 
     FILE *fp;
@@ -216,6 +396,7 @@ public:
       }
 
       p.compute_distances();
+      p.compute_cartesian();
       double Q = p.compute_mean_Q();
       Qmin = std::min<double>(Qmin, Q);
       Qmax = std::max<double>(Qmax, Q);
@@ -228,22 +409,137 @@ public:
     }
     
     fclose(fp);
+
+    for (int i = 0; i < (int)data.size(); i ++) {
+      order.push_back(i);
+    }
   }
 
   ~attenuationdataS2()
   {
   }
 
+  //
+  // Sort the paths along a Hilbert curve through their mid points so that consecutive paths
+  // sample the same or neighbouring cells. The points of each path remain in order along the
+  // path. The original index of each path is kept in order.
+  //
+  void spatial_order()
+  {
+    std::vector<std::pair<uint64_t, int>> keys;
+    
+    for (int i = 0; i < (int)data.size(); i ++) {
+      vector3<value> mid;
+      
+      for (auto &p : data[i].points) {
+	vector3<value> v;
+	sphericalcoordinate<value>::sphericaltocartesian(p.phi, p.theta, v);
+	mid += v;
+      }
+
+      keys.push_back(std::pair<uint64_t, int>(hilbert_key(mid), i));
+    }
+
+    std::stable_sort(keys.begin(), keys.end(),
+		     [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) {
+		       return a.first < b.first;
+		     });
+
+    std::vector<pathS2<value>> sorted;
+    std::vector<int> sorted_order;
+    for (auto &k : keys) {
+      sorted.push_back(data[k.second]);
+      sorted_order.push_back(order[k.second]);
+    }
+
+    data.swap(sorted);
+    order.swap(sorted_order);
+  }
+
+  //
+  // Copy per path values (eg residuals) from the current order back to the order of the
+  // observations file
+  //
+  void restore_order(const value *current, value *original) const
+  {
+    for (int i = 0; i < (int)order.size(); i ++) {
+      original[order[i]] = current[i];
+    }
+  }
+
+  //
+  // Select the exact segment walk forward model instead of the sum over points
+  //
+  void set_exact_integration(bool _exact)
+  {
+    exact = _exact;
+  }
+
+  //
+  // Cell geometry prepared once per likelihood evaluation for the exact forward model (the
+  // centres, values and natural neighbours of the cells) and the cell of the last point of
+  // the previous path to start point location from.
+  //
+  struct cells_t {
+    cells_t() :
+      hint(-1)
+    {
+    }
+    
+    std::vector<vector3<value>> centres;
+    std::vector<value> values;
+    std::vector<int> offsets;
+    std::vector<int> neighbours;
+    int hint;
+  };
+
+  void prepare(const sphericalvoronoimodel<value> &model, cells_t &cells) const
+  {
+    if (exact) {
+      model.cartesian_cells(cells.centres, cells.values);
+
+      cells.offsets.clear();
+      cells.neighbours.clear();
+      
+      std::vector<int> nn;
+      cells.offsets.push_back(0);
+      for (int i = 0; i < model.ncells(); i ++) {
+	if (!model.neighbours(i, nn)) {
+	  cells.offsets.clear();
+	  cells.neighbours.clear();
+	  break;
+	}
+
+	cells.neighbours.insert(cells.neighbours.end(), nn.begin(), nn.end());
+	cells.offsets.push_back((int)cells.neighbours.size());
+      }
+    }
+  }
+
+  value predicted_tstar(pathS2<value> &d,
+			const sphericalvoronoimodel<value> &model,
+			cells_t &cells) const
+  {
+    if (exact) {
+      return d.predicted_tstar_exact(cells.centres, cells.values, cells.offsets, cells.neighbours, cells.hint);
+    } else {
+      return d.predicted_tstar_direct(model, cells.hint);
+    }
+  }
+
   value likelihood(const sphericalvoronoimodel<value> &model,
 		   double lambda,
 		   value *residuals)
   {
     value sum = 0.0;
+    cells_t cells;
+
+    prepare(model, cells);
     int i = 0;
 
     for (auto &d : data) {
 
-      value pred = d.predicted_tstar_direct(model);
+      value pred = predicted_tstar(d, model, cells);
       value res = pred - d.tstar;
       double sigma = d.noise * lambda;
 
@@ -263,12 +559,15 @@ public:
 			   value *residuals)
   {
     value sum = 0.0;
+    cells_t cells;
+
+    prepare(model, cells);
 
     for (int i = 0; i < size; i ++) {
 
       auto &d = data[offset + i];
 
-      value pred = d.predicted_tstar_direct(model);
+      value pred = predicted_tstar(d, model, cells);
       value res = pred - d.tstar;
       double sigma = d.noise * lambda;
 
@@ -281,6 +580,131 @@ public:
     return sum;
   }
 
+  //
+  // Likelihoods of several models over a range of paths computed in one pass so that the
+  // ray points are streamed once for the batch. The residuals of model m are written to
+  // residuals[m] (indexed from the start of the range) and its negative log likelihood
+  // with noise scaling lambdas[m] to likelihoods[m].
+  //
+  void likelihood_batch(int nmodels,
+			const sphericalvoronoimodel<value> * const *models,
+			const double *lambdas,
+			int offset,
+			int size,
+			value * const *residuals,
+			value *likelihoods)
+  {
+    std::vector<value> pred(nmodels);
+    std::vector<cells_t> cells(nmodels);
+    std::vector<int> hints(nmodels, -1);
+
+    for (int m = 0; m < nmodels; m ++) {
+      likelihoods[m] = 0.0;
+      prepare(*models[m], cells[m]);
+    }
+    
+    for (int i = 0; i < size; i ++) {
+
+      auto &d = data[offset + i];
+
+      if (exact) {
+	for (int m = 0; m < nmodels; m ++) {
+	  pred[m] = d.predicted_tstar_exact(cells[m].centres,
+					    cells[m].values,
+					    cells[m].offsets,
+					    cells[m].neighbours,
+					    cells[m].hint);
+	}
+      } else {
+	d.predicted_tstar_batch(nmodels, models, pred.data(), hints.data());
+      }
+
+      for (int m = 0; m < nmodels; m ++) {
+	value res = pred[m] - d.tstar;
+	double sigma = d.noise * lambdas[m];
+
+	residuals[m][i] = res;
+
+	likelihoods[m] += res*res/(2.0 * sigma * sigma);
+      }
+    }
+  }
+
+  //
+  // Cheap approximation of the likelihood over the range using only the paths whose index
+  // is a multiple of stride, scaled by stride to estimate the full sum. Only the residuals
+  // of the sampled paths are written.
+  //
+  value likelihood_decimated(const sphericalvoronoimodel<value> &model,
+			     double lambda,
+			     int offset,
+			     int size,
+			     int stride,
+			     value *residuals)
+  {
+    value sum = 0.0;
+    cells_t cells;
+
+    prepare(model, cells);
+    int first = ((offset + stride - 1)/stride) * stride - offset;
+
+    for (int i = first; i < size; i += stride) {
+
+      auto &d = data[offset + i];
+
+      value pred = predicted_tstar(d, model, cells);
+      value res = pred - d.tstar;
+      double sigma = d.noise * lambda;
+
+      residuals[i] = res;
+      
+      sum += res*res/(2.0 * sigma * sigma);
+      
+    }
+
+    return sum * (value)stride;
+  }
+
+  //
+  // As above but the summation is abandoned once the partial sum exceeds the threshold. As
+  // each term is non-negative, the full sum is then guaranteed to exceed the threshold. The
+  // returned value is the partial sum, complete is set false and the residuals are incomplete.
+  //
+  value likelihood_partial(const sphericalvoronoimodel<value> &model,
+			   double lambda,
+			   int offset,
+			   int size,
+			   value *residuals,
+			   value threshold,
+			   bool &complete)
+  {
+    value sum = 0.0;
+    cells_t cells;
+
+    prepare(model, cells);
+
+    complete = true;
+    for (int i = 0; i < size; i ++) {
+
+      auto &d = data[offset + i];
+
+      value pred = predicted_tstar(d, model, cells);
+      value res = pred - d.tstar;
+      double sigma = d.noise * lambda;
+
+      residuals[i] = res;
+      
+      sum += res*res/(2.0 * sigma * sigma);
+
+      if (sum > threshold) {
+	complete = false;
+	break;
+      }
+    }
+
+    return sum;
+  }
+
   double phimin, phimax;
   double thetamin, thetamax;
   double Qmin, Qmax;
@@ -289,6 +713,62 @@ public:
   double Qmean;
   
   std::vector<pathS2<value>> data;
+  std::vector<int> order;
+
+  bool exact;
+
+private:
+
+  //
+  // Position along a Hilbert curve on the faces of the cube enclosing the sphere
+  //
+  static uint64_t hilbert_key(const vector3<value> &v)
+  {
+    const uint32_t N = 1U << 16;
+    
+    value ax = fabs(v.x);
+    value ay = fabs(v.y);
+    value az = fabs(v.z);
+    
+    int face;
+    value u, w;
+    if (ax >= ay && ax >= az) {
+      face = v.x > 0.0 ? 0 : 3;
+      u = v.y/ax;
+      w = v.z/ax;
+    } else if (ay >= az) {
+      face = v.y > 0.0 ? 1 : 4;
+      u = v.z/ay;
+      w = v.x/ay;
+    } else if (az > 0.0) {
+      face = v.z > 0.0 ? 2 : 5;
+      u = v.x/az;
+      w = v.y/az;
+    } else {
+      return 0;
+    }
+
+    uint32_t x = std::min<uint32_t>(N - 1, (uint32_t)((u + 1.0)/2.0 * N));
+    uint32_t y = std::min<uint32_t>(N - 1, (uint32_t)((w + 1.0)/2.0 * N));
+
+    uint64_t d = 0;
+    for (uint32_t s = N/2; s > 0; s /= 2) {
+      uint32_t rx = (x & s) > 0;
+      uint32_t ry = (y & s) > 0;
+      
+      d += (uint64_t)s * s * ((3 * rx) ^ ry);
+
+      if (ry == 0) {
+	if (rx == 1) {
+	  x = N - 1 - x;
+	  y = N - 1 - y;
+	}
+	std::swap(x, y);
+      }
+    }
+
+    return ((uint64_t)face << 32) | d;
+  }
 };
 
 #endif // attenuationdataS2_hpp
@@ -32,17 +32,24 @@
 #include "globalS2Voronoi.hpp"
 
 #include "perturbationcollectionS2Voronoi.hpp"
+#include "staticperturbationcollectionS2Voronoi.hpp"
 #include "valueS2Voronoi.hpp"
+#include "conditionalvalueS2Voronoi.hpp"
+#include "birthconditionalS2Voronoi.hpp"
+#include "deathconditionalS2Voronoi.hpp"
+#include "convergencemonitor.hpp"
 #include "birthgenericS2Voronoi.hpp"
 #include "deathgenericS2Voronoi.hpp"
 #include "moveS2Voronoi.hpp"
 #include "hierarchicalS2Voronoi.hpp"
+#include "speculativeS2Voronoi.hpp"
 
+#include "instrumentation.hpp"
 #include "pathutil.hpp"
 
 typedef chainhistorywriterVoronoi<sphericalcoordinate<double>, double> chainhistorywriter_t;
 
-static char short_options[] = "i:I:o:P:H:M:B:D:T:S:t:l:v:b:pLh";
+static char short_options[] = "i:I:o:P:H:M:B:D:T:S:t:l:v:b:pLRA:K:j:EswgGk:e:a:q:h";
 static struct option long_options[] = {
   {"input", required_argument, 0, 'i'},
   {"initial", required_argument, 0, 'I'},
@@ -63,13 +70,81 @@ static struct option long_options[] = {
   {"birth-probability", required_argument, 0, 'b'},
   {"posterior", no_argument, 0, 'p'},
   {"logspace", no_argument, 0, 'L'},
+  {"early-reject", no_argument, 0, 'R'},
+  {"exact-integration", no_argument, 0, 'E'},
+  {"spatial-order", no_argument, 0, 's'},
+  {"weight-operator", no_argument, 0, 'w'},
+  {"conditional-value", no_argument, 0, 'g'},
+  {"conditional-birth-death", no_argument, 0, 'G'},
+  {"check-interval", required_argument, 0, 'k'},
+  {"target-ess", required_argument, 0, 'e'},
+  {"adapt", required_argument, 0, 'a'},
+  {"target-acceptance", required_argument, 0, 'q'},
+  {"delayed-acceptance", required_argument, 0, 'A'},
+  {"speculative", required_argument, 0, 'K'},
+  {"speculative-threads", required_argument, 0, 'j'},
   
   {"help", no_argument, 0, 'h'},
   {0, 0, 0, 0}
 };
 
+//
+// Iterations between adjustments of the proposal widths during adaptive burn in
+//
+static const int ADAPTATION_INTERVAL = 100;
+
+//
+// Settings used within the iterations of the chain
+//
+struct config_t {
+  int total;
+  int verbosity;
+  int maxcells;
+  int delayedacceptance;
+  bool earlyreject;
+  int speculative;
+  int checkinterval;
+  double targetess;
+  int adapt;
+  double targetacceptance;
+  bool hierarchical;
+};
+
+typedef StaticPerturbationCollectionS2Voronoi<double,
+					      ValueS2Voronoi<double>,
+					      MoveS2Voronoi<double>,
+					      BirthGenericS2Voronoi<double>,
+					      DeathGenericS2Voronoi<double>> standardcollection_t;
+
+typedef StaticPerturbationCollectionS2Voronoi<double,
+					      ValueS2Voronoi<double>,
+					      MoveS2Voronoi<double>,
+					      BirthGenericS2Voronoi<double>,
+					      DeathGenericS2Voronoi<double>,
+					      HierarchicalS2Voronoi<double>> standardhierarchicalcollection_t;
+
 static void usage(const char *pname);
 
+template
+<typename collection>
+static void run_chain(collection &pc,
+		      SpeculativeS2Voronoi<double> *spec,
+		      globalS2Voronoi<double> &global,
+		      chainhistorywriter_t &history,
+		      int *khistogram,
+		      const config_t &config,
+		      double &current_likelihood,
+		      double &current_surrogate,
+		      int &screened_out);
+
+static void add_perturbations(PerturbationCollectionS2Voronoi<double> &pc,
+			      globalS2Voronoi<double> &global,
+			      bool posterior,
+			      double Pb,
+			      bool hierarchical,
+			      bool conditionalvalue,
+			      bool conditional);
+
 int main(int argc, char *argv[])
 {
   int c;
@@ -101,6 +176,20 @@ int main(int argc, char *argv[])
   double Pb;
 
   bool logspace;
+
+  bool earlyreject;
+  bool exact;
+  bool spatialorder;
+  bool weightoperator;
+  bool conditionalvalue;
+  bool conditional;
+  int checkinterval;
+  double targetess;
+  int adapt;
+  double targetacceptance;
+  int delayedacceptance;
+  int speculative;
+  int speculativethreads;
   
   //
   // State
@@ -108,6 +197,8 @@ int main(int argc, char *argv[])
   globalS2Voronoi<double> *global;
   
   double current_likelihood;
+  double current_surrogate;
+  int screened_out;
 
   //
   // Misc
@@ -140,6 +231,20 @@ int main(int argc, char *argv[])
   Pb = 0.05;
 
   logspace = false;
+
+  earlyreject = false;
+  exact = false;
+  spatialorder = false;
+  weightoperator = false;
+  conditionalvalue = false;
+  conditional = false;
+  checkinterval = 0;
+  targetess = 0.0;
+  adapt = 0;
+  targetacceptance = 0.3;
+  delayedacceptance = 0;
+  speculative = 0;
+  speculativethreads = 0;
   
   option_index = 0;
   while (1) {
@@ -226,8 +331,89 @@ int main(int argc, char *argv[])
     case 'L':
       logspace = true;
       break;
-	
-      
+
+    case 'R':
+      earlyreject = true;
+      break;
+
+    case 'E':
+      exact = true;
+      break;
+
+    case 's':
+      spatialorder = true;
+      break;
+
+    case 'w':
+      weightoperator = true;
+      break;
+
+    case 'g':
+      conditionalvalue = true;
+      weightoperator = true;
+      break;
+
+    case 'G':
+      conditional = true;
+      weightoperator = true;
+      break;
+
+    case 'k':
+      checkinterval = atoi(optarg);
+      if (checkinterval < 0) {
+	fprintf(stderr, "error: check interval must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'e':
+      targetess = atof(optarg);
+      if (targetess < 0.0) {
+	fprintf(stderr, "error: target ess must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'a':
+      adapt = atoi(optarg);
+      if (adapt < 0) {
+	fprintf(stderr, "error: adaptation iterations must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'q':
+      targetacceptance = atof(optarg);
+      if (targetacceptance <= 0.0 || targetacceptance >= 1.0) {
+	fprintf(stderr, "error: target acceptance must be between 0 and 1\n");
+	return -1;
+      }
+      break;
+
+    case 'A':
+      delayedacceptance = atoi(optarg);
+      if (delayedacceptance < 0) {
+	fprintf(stderr, "error: delayed acceptance stride must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'K':
+      speculative = atoi(optarg);
+      if (speculative < 0) {
+	fprintf(stderr, "error: no. speculative proposals must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'j':
+      speculativethreads = atoi(optarg);
+      if (speculativethreads < 1) {
+	fprintf(stderr, "error: no. speculative threads must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
     case 'h':
     default:
       usage(argv[0]);
@@ -241,6 +427,29 @@ int main(int argc, char *argv[])
     return -1;
   }
 
+  if (targetess > 0.0 && checkinterval == 0) {
+    checkinterval = 1000;
+  }
+
+  if (speculativethreads == 0 || speculativethreads > speculative) {
+    speculativethreads = speculative;
+  }
+
+  if (speculative > 0 && delayedacceptance > 0) {
+    fprintf(stderr, "error: speculative evaluation cannot be combined with delayed acceptance\n");
+    return -1;
+  }
+
+  if (adapt > 0 && speculative > 0) {
+    fprintf(stderr, "error: adaptive proposals cannot be combined with speculative evaluation\n");
+    return -1;
+  }
+
+  if (weightoperator && (exact || speculative > 0)) {
+    fprintf(stderr, "error: weight operator cannot be combined with exact integration or speculative evaluation\n");
+    return -1;
+  }
+
   global = new globalS2Voronoi<double>(input,
 				       initial,
 				       prior,
@@ -253,98 +462,98 @@ int main(int argc, char *argv[])
 				       seed,
 				       posterior,
 				       logspace);
+
+  if (exact && global->data != nullptr) {
+    global->data->set_exact_integration(true);
+  }
+
+  if (spatialorder && global->data != nullptr) {
+    global->data->spatial_order();
+  }
+
+  if (weightoperator) {
+    global->enable_weight_operator();
+  }
+  
+  current_surrogate = 0.0;
+  screened_out = 0;
+  if (delayedacceptance > 0) {
+    global->surrogate_stride = delayedacceptance;
+    current_surrogate = global->surrogate_likelihood();
+  }
   
   current_likelihood = global->likelihood();
   printf("Initial likelihood: %10.6f\n", current_likelihood);
   global->accept();
+  global->update_birth_proposal();
 
   int *khistogram = new int[global->maxcells + 1];
   for (int i = 0; i <= global->maxcells; i ++) {
     khistogram[i] = 0;
   }
 
-  PerturbationCollectionS2Voronoi<double> pc;
   mkpath(output, "ch.dat", filename);
   chainhistorywriter_t *history = new chainhistorywriter_t(filename,
 							   *(global->model),
 							   *(global->hierarchical),
 							   current_likelihood);
 
-  if (posterior) {
-    pc.add(new ValueS2Voronoi<double>(), 0.1);
-
-    pc.add(new BirthGenericS2Voronoi<double>(global->birthdeathvalueproposal,
-					     global->birthdeathpositionproposal), 1.0);
-    pc.add(new DeathGenericS2Voronoi<double>(global->birthdeathvalueproposal,
-					     global->birthdeathpositionproposal), 1.0);
-  } else {
-    pc.add(new ValueS2Voronoi<double>(), 1.0);
-
-    if (Pb > 0.0) {
-      pc.add(new MoveS2Voronoi<double>(), 0.5);
-      
-      pc.add(new BirthGenericS2Voronoi<double>(global->birthdeathvalueproposal,
-					       global->birthdeathpositionproposal), Pb);
-      pc.add(new DeathGenericS2Voronoi<double>(global->birthdeathvalueproposal,
-					       global->birthdeathpositionproposal), Pb);
-    }
-
-    if (hierarchicalprior != nullptr) {
-      pc.add(new HierarchicalS2Voronoi<double>(), 0.5);
-    }
+  SpeculativeS2Voronoi<double> *spec = nullptr;
+  if (speculative > 0) {
+    spec = new SpeculativeS2Voronoi<double>(*global,
+					    speculative,
+					    speculativethreads,
+					    seed,
+					    earlyreject,
+					    [&](PerturbationCollectionS2Voronoi<double> &tpc,
+						globalS2Voronoi<double> &tglobal) {
+					      add_perturbations(tpc, tglobal, posterior, Pb,
+								hierarchicalprior != nullptr, false, false);
+					    });
   }
 
-  for (int i = 0; i < total; i ++) {
+  config_t config;
+  config.total = total;
+  config.verbosity = verbosity;
+  config.maxcells = maxcells;
+  config.delayedacceptance = delayedacceptance;
+  config.earlyreject = earlyreject;
+  config.speculative = speculative;
+  config.checkinterval = checkinterval;
+  config.targetess = targetess;
+  config.adapt = adapt;
+  config.targetacceptance = targetacceptance;
+  config.hierarchical = (hierarchicalprior != nullptr);
+
+  if (spec == nullptr && !posterior && !conditionalvalue && !conditional && Pb > 0.0) {
+    //
+    // The standard perturbations are known at compile time so are dispatched statically
+    //
+    ValueS2Voronoi<double> value;
+    MoveS2Voronoi<double> move;
+    BirthGenericS2Voronoi<double> birth(global->birthdeathvalueproposal,
+					global->birthdeathpositionproposal);
+    DeathGenericS2Voronoi<double> death(global->birthdeathvalueproposal,
+					global->birthdeathpositionproposal);
     
-    double log_prior_ratio;
-    double log_proposal_ratio;
-    PerturbationS2Voronoi<double>::delta_t *perturbation = nullptr;
-    
-    if (pc.propose(*global, log_prior_ratio, perturbation)) {
-      
-      if (perturbation == nullptr) {
-	throw ATTENUATIONEXCEPTION("Valid proposal has null perturbation\n");
-      }
-
-      double u = log(global->random.uniform());
-
-      double proposed_likelihood = global->likelihood();
-      perturbation->set_proposed_likelihood(proposed_likelihood);
-
-      log_proposal_ratio = pc.log_proposal_ratio(*global);
-
-      if (u < (current_likelihood - proposed_likelihood + log_prior_ratio + log_proposal_ratio)) {
-
-	pc.accept(*global);
-	perturbation->accept();
-	global->accept();
-	
-	current_likelihood = proposed_likelihood;
-      } else {
-	pc.reject(*global);
-	perturbation->reject(); 
-	global->reject();
-      }
-    }
-
-    if (verbosity > 0 && (i + 1) % verbosity == 0) {
-
-      printf("%5d: Cells %d Likelihood %10.6f Lambda %10.6f\n",
-             i + 1,
-             (int)global->model->ncells(),
-             current_likelihood,
-             global->hierarchical->get(0));
-
-      pc.writeacceptancereport(stdout);
-    }
-      
-    int k = global->model->ncells();
-    if (k < 1 || k > maxcells) {
-      throw ATTENUATIONEXCEPTION("k out of range: %d (%d)\n", k, maxcells);
+    if (config.hierarchical) {
+      standardhierarchicalcollection_t pc({1.0, 0.5, Pb, Pb, 0.5},
+					  value, move, birth, death,
+					  HierarchicalS2Voronoi<double>());
+      run_chain(pc, spec, *global, *history, khistogram, config,
+		current_likelihood, current_surrogate, screened_out);
+    } else {
+      standardcollection_t pc({1.0, 0.5, Pb, Pb},
+			      value, move, birth, death);
+      run_chain(pc, spec, *global, *history, khistogram, config,
+		current_likelihood, current_surrogate, screened_out);
     }
-    khistogram[k] ++;
-      
-    history->add(perturbation);
+    
+  } else {
+    PerturbationCollectionS2Voronoi<double> pc;
+    add_perturbations(pc, *global, posterior, Pb, config.hierarchical, conditionalvalue, conditional);
+    run_chain(pc, spec, *global, *history, khistogram, config,
+	      current_likelihood, current_surrogate, screened_out);
   }
 
   //
@@ -358,19 +567,25 @@ int main(int argc, char *argv[])
   fclose(fp);
   delete [] khistogram;
 
+  mkpath(output, "instrumentation.txt", filename);
+  INSTRUMENT_WRITE(filename);
+
   //
   // Save residuals
   //
   mkpath(output, "residuals.txt", filename);
   fp = fopen(filename, "w");
+  const double *mean_residuals = global->get_mean_residuals();
   for (int i = 0; i < global->residual_size; i ++) {
-    fprintf(fp, "%.9g\n", global->mean_residuals[i]);
+    fprintf(fp, "%.9g\n", mean_residuals[i]);
   }
   fclose(fp);
   
   history->flush();
 
   delete history;
+  delete spec;
+  delete global;
 
   return 0;
 }
@@ -396,6 +611,19 @@ static void usage(const char *pname)
 	  " -l|--lambda <float>                     Initial/fixed lambda parameter\n"
 	  "\n"
 	  " -L|--logspace                           Model is in log(Q)\n"
+	  " -R|--early-reject                       Stop likelihood evaluation once rejection is certain\n"
+	  " -E|--exact-integration                  Integrate t* exactly through the Voronoi cells\n"
+	  " -s|--spatial-order                      Order the paths along a space filling curve\n"
+	  " -w|--weight-operator                    Update predictions incrementally with the path/cell weights\n"
+	  " -g|--conditional-value                  Propose cell values from their approximate conditional (implies -w)\n"
+	  " -G|--conditional-birth-death            Birth values from their approximate conditional (implies -w)\n"
+	  " -A|--delayed-acceptance <int>           Screen proposals with every nth path first (0 = off)\n"
+	  " -K|--speculative <int>                  No. proposals evaluated speculatively at once (0 = off)\n"
+	  " -j|--speculative-threads <int>          No. threads for speculative proposals (default one per proposal)\n"
+	  " -k|--check-interval <int>               Iterations between convergence diagnostics (0 = none)\n"
+	  " -e|--target-ess <float>                 Stop once the effective sample size reaches this (0 = run to total)\n"
+	  " -a|--adapt <int>                        Burn in iterations over which proposal widths are tuned (0 = off)\n"
+	  " -q|--target-acceptance <float>          Acceptance rate the proposal widths are tuned toward (default 0.3)\n"
 	  " -T|--max-cells <int>                    Max no. Voronoi cells\n"
 	  " -b|--birth-probability <float>          Relative probability of birth\n"
 	  " -p|--posterior                          Posterior test\n"
@@ -405,3 +633,242 @@ static void usage(const char *pname)
 	  pname);
 
 }
+
+static void add_perturbations(PerturbationCollectionS2Voronoi<double> &pc,
+			      globalS2Voronoi<double> &global,
+			      bool posterior,
+			      double Pb,
+			      bool hierarchical,
+			      bool conditionalvalue,
+			      bool conditional)
+{
+  if (posterior) {
+    pc.add(new ValueS2Voronoi<double>(), 0.1);
+
+    pc.add(new BirthGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+					     global.birthdeathpositionproposal), 1.0);
+    pc.add(new DeathGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+					     global.birthdeathpositionproposal), 1.0);
+  } else {
+    if (conditionalvalue) {
+      pc.add(new ConditionalValueS2Voronoi<double>(global), 1.0);
+    } else {
+      pc.add(new ValueS2Voronoi<double>(), 1.0);
+    }
+
+    if (Pb > 0.0) {
+      pc.add(new MoveS2Voronoi<double>(), 0.5);
+
+      if (conditional) {
+	pc.add(new BirthConditionalS2Voronoi<double>(global), Pb);
+	pc.add(new DeathConditionalS2Voronoi<double>(global), Pb);
+      } else {
+	pc.add(new BirthGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+						 global.birthdeathpositionproposal), Pb);
+	pc.add(new DeathGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+						 global.birthdeathpositionproposal), Pb);
+      }
+    }
+
+    if (hierarchical) {
+      pc.add(new HierarchicalS2Voronoi<double>(), 0.5);
+    }
+  }
+}
+
+//
+// Runs the iterations of the chain with either the dynamic or a static perturbation collection
+//
+template
+<typename collection>
+static void run_chain(collection &pc,
+		      SpeculativeS2Voronoi<double> *spec,
+		      globalS2Voronoi<double> &global,
+		      chainhistorywriter_t &history,
+		      int *khistogram,
+		      const config_t &config,
+		      double &current_likelihood,
+		      double &current_surrogate,
+		      int &screened_out)
+{
+  convergencemonitor monitor(config.hierarchical);
+
+  int spec_next = 0;
+  int spec_consumed = 0;
+  
+  for (int i = 0; i < config.total; i ++) {
+    
+    double log_prior_ratio;
+    double log_proposal_ratio;
+    PerturbationS2Voronoi<double>::delta_t *perturbation = nullptr;
+    
+    if (spec != nullptr) {
+      //
+      // Proposals are evaluated speculatively in batches then resolved one iteration at
+      // a time in order
+      //
+      if (spec_next == spec_consumed) {
+	spec_consumed = spec->evaluate(std::min(config.speculative, config.total - i), current_likelihood);
+	spec_next = 0;
+      }
+
+      perturbation = spec->resolve(spec_next, current_likelihood);
+      spec_next ++;
+      
+    } else if (pc.propose(global, log_prior_ratio, perturbation)) {
+      
+      if (perturbation == nullptr) {
+	throw ATTENUATIONEXCEPTION("Valid proposal has null perturbation\n");
+      }
+
+      double u = log(global.random.uniform());
+
+      double proposed_likelihood;
+      double proposed_surrogate = 0.0;
+      double log_ratio = 0.0;
+      bool complete = true;
+      bool screened = true;
+
+      if (config.delayedacceptance > 0) {
+	//
+	// First stage screens the proposal using the surrogate likelihood. Survivors are then
+	// accepted with the ratio of the full to surrogate likelihood ratios which corrects
+	// for the approximation so that the posterior is unchanged.
+	//
+	log_proposal_ratio = pc.log_proposal_ratio(global);
+
+	INSTRUMENT_START(LIKELIHOOD);
+	proposed_surrogate = global.surrogate_likelihood();
+	INSTRUMENT_END(LIKELIHOOD);
+	screened = u < (current_surrogate - proposed_surrogate + log_prior_ratio + log_proposal_ratio);
+	if (screened) {
+	  u = log(global.random.uniform());
+	} else {
+	  screened_out ++;
+	}
+	
+	log_ratio = proposed_surrogate - current_surrogate;
+	
+      } else if (config.earlyreject) {
+	//
+	// The proposal ratio is known before the likelihood so the evaluation can
+	// be abandoned once rejection is certain.
+	//
+	log_proposal_ratio = pc.log_proposal_ratio(global);
+	log_ratio = log_prior_ratio + log_proposal_ratio;
+      }
+
+      if (!screened) {
+	proposed_likelihood = proposed_surrogate;
+      } else if (config.earlyreject) {
+	INSTRUMENT_START(LIKELIHOOD);
+	proposed_likelihood = global.likelihood(current_likelihood + log_ratio - u, complete);
+	INSTRUMENT_END(LIKELIHOOD);
+      } else {
+	INSTRUMENT_START(LIKELIHOOD);
+	proposed_likelihood = global.likelihood();
+	INSTRUMENT_END(LIKELIHOOD);
+	
+	if (config.delayedacceptance == 0) {
+	  log_proposal_ratio = pc.log_proposal_ratio(global);
+	  log_ratio = log_prior_ratio + log_proposal_ratio;
+	}
+      }
+      
+      perturbation->set_proposed_likelihood(proposed_likelihood);
+
+      INSTRUMENT_START(ACCEPT);
+      if (screened && complete &&
+	  u < (current_likelihood - proposed_likelihood + log_ratio)) {
+
+	pc.accept(global);
+	perturbation->accept();
+	global.accept();
+	
+	current_likelihood = proposed_likelihood;
+	current_surrogate = proposed_surrogate;
+      } else {
+	pc.reject(global);
+	perturbation->reject(); 
+	global.reject();
+      }
+      INSTRUMENT_END(ACCEPT);
+    }
+
+    if (config.verbosity > 0 && (i + 1) % config.verbosity == 0) {
+
+      printf("%5d: Cells %d Likelihood %10.6f Lambda %10.6f\n",
+             i + 1,
+             (int)global.model->ncells(),
+             current_likelihood,
+             global.hierarchical->get(0));
+
+      if (spec != nullptr) {
+	printf("%s", spec->generateacceptancereport().c_str());
+      } else {
+	pc.writeacceptancereport(stdout);
+      }
+
+      if (config.delayedacceptance > 0) {
+	printf("  Screened out: %d\n", screened_out);
+      }
+    }
+      
+    int k = global.model->ncells();
+    if (k < 1 || k > config.maxcells) {
+      throw ATTENUATIONEXCEPTION("k out of range: %d (%d)\n", k, config.maxcells);
+    }
+    khistogram[k] ++;
+      
+    INSTRUMENT_START(HISTORY);
+    history.add(perturbation);
+    INSTRUMENT_END(HISTORY);
+
+    if (i < config.adapt) {
+      //
+      // Tune the proposal widths and the residual birth proposal (if any) during burn in
+      // then fix them from here on so that the
+      // remainder of the chain samples the posterior
+      //
+      if ((i + 1) % ADAPTATION_INTERVAL == 0) {
+	pc.adapt(global, config.targetacceptance);
+	global.update_birth_proposal();
+      }
+
+      if (i + 1 == config.adapt) {
+	std::vector<std::string> names;
+	std::vector<double> scales;
+
+	pc.adaptation(global, names, scales);
+	history.add(new adaptation_deltaVoronoi<sphericalcoordinate<double>, double>(names, scales));
+
+	printf("Adapted proposals after %d iterations\n", i + 1);
+	printf("%s", pc.generateadaptationreport(global).c_str());
+	INFO("Adapted proposals after %d iterations\n%s", i + 1, pc.generateadaptationreport(global).c_str());
+      }
+    }
+
+    if (config.checkinterval > 0) {
+      monitor.add(current_likelihood, k, global.hierarchical->get(0));
+
+      if ((i + 1) % config.checkinterval == 0) {
+	convergencemonitor::diagnostics_t d;
+	convergencemonitor::combine(MPI_COMM_NULL, &monitor, d);
+
+	for (int s = 0; s < convergencemonitor::NSERIES; s ++) {
+	  printf("%5d: %10s ESS %10.1f IAT %10.2f\n",
+		 i + 1,
+		 convergencemonitor::name(s),
+		 d.ess[s],
+		 d.iat[s]);
+	}
+
+	if (config.targetess > 0.0 && convergencemonitor::converged(d, config.targetess, 0.0)) {
+	  printf("Converged after %d iterations\n", i + 1);
+	  INFO("Converged after %d iterations\n", i + 1);
+	  break;
+	}
+      }
+    }
+  }
+}
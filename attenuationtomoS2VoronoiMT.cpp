@@ -0,0 +1,689 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <getopt.h>
+
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "attenuationdataS2.hpp"
+
+#include "globalS2Voronoi.hpp"
+
+#include "perturbationcollectionS2Voronoi.hpp"
+#include "valueS2Voronoi.hpp"
+#include "conditionalvalueS2Voronoi.hpp"
+#include "birthconditionalS2Voronoi.hpp"
+#include "deathconditionalS2Voronoi.hpp"
+#include "birthgenericS2Voronoi.hpp"
+#include "deathgenericS2Voronoi.hpp"
+#include "moveS2Voronoi.hpp"
+#include "hierarchicalS2Voronoi.hpp"
+#include "chainhistorymultiplexerVoronoi.hpp"
+
+#include "instrumentation.hpp"
+#include "pathutil.hpp"
+
+typedef chainhistorywriterVoronoi<sphericalcoordinate<double>, double> chainhistorywriter_t;
+typedef chainhistorymultiplexerVoronoi<sphericalcoordinate<double>, double> chainhistorymultiplexer_t;
+
+static char short_options[] = "i:I:o:P:H:M:B:T:t:l:v:b:pLREswgGc:f:h";
+static struct option long_options[] = {
+  {"input", required_argument, 0, 'i'},
+  {"initial", required_argument, 0, 'I'},
+  {"output", required_argument, 0, 'o'},
+
+  {"prior", required_argument, 0, 'P'},
+  {"hierarchical-prior", required_argument, 0, 'H'},
+  {"move-prior", required_argument, 0, 'M'},
+  {"birth-death-prior", required_argument, 0, 'B'},
+
+  {"max-cells", required_argument, 0, 'T'},
+
+  {"total", required_argument, 0, 't'},
+  {"lambda", required_argument, 0, 'l'},
+
+  {"verbosity", required_argument, 0, 'v'},
+
+  {"birth-probability", required_argument, 0, 'b'},
+  {"posterior", no_argument, 0, 'p'},
+  {"logspace", no_argument, 0, 'L'},
+  {"early-reject", no_argument, 0, 'R'},
+  {"exact-integration", no_argument, 0, 'E'},
+  {"spatial-order", no_argument, 0, 's'},
+  {"weight-operator", no_argument, 0, 'w'},
+  {"conditional-value", no_argument, 0, 'g'},
+  {"conditional-birth-death", no_argument, 0, 'G'},
+
+  {"chains", required_argument, 0, 'c'},
+  {"flush-interval", required_argument, 0, 'f'},
+
+  {"help", no_argument, 0, 'h'},
+  {0, 0, 0, 0}
+};
+
+//
+// State of one chain, each run on its own thread
+//
+struct chain_t {
+  int id;
+  globalS2Voronoi<double> *global;
+  PerturbationCollectionS2Voronoi<double> *pc;
+  chainhistorywriter_t *history;
+  int *khistogram;
+  double current_likelihood;
+  std::exception_ptr error;
+};
+
+//
+// Configuration shared by all chains
+//
+struct chain_config_t {
+  int total;
+  int verbosity;
+  int flushinterval;
+  bool earlyreject;
+  const char *output;
+};
+
+static std::mutex log_mutex;
+
+static void usage(const char *pname);
+
+static void add_perturbations(PerturbationCollectionS2Voronoi<double> &pc,
+			      globalS2Voronoi<double> &global,
+			      bool posterior,
+			      double Pb,
+			      bool hierarchical,
+			      bool conditionalvalue,
+			      bool conditional);
+
+static void run_chain(chain_t &chain, const chain_config_t &config, chainhistorymultiplexer_t &mux);
+
+int main(int argc, char *argv[])
+{
+  int c;
+  int option_index;
+
+  //
+  // Configuration
+  //
+  char *input;
+  char *initial;
+  char *output;
+
+  char *prior;
+  char *hierarchicalprior;
+  char *positionprior;
+  char *birthdeathprior;
+
+  int maxcells;
+
+  double lambda;
+
+  int seed_base;
+  int seed_mult;
+
+  bool posterior;
+
+  double Pb;
+
+  bool logspace;
+  bool exact;
+  bool spatialorder;
+  bool weightoperator;
+  bool conditionalvalue;
+  bool conditional;
+
+  int chains;
+
+  chain_config_t config;
+
+  //
+  // Misc
+  //
+  char filename[1024];
+
+  //
+  // Initialize defaults
+  //
+  input = nullptr;
+  initial = nullptr;
+  output = nullptr;
+
+  prior = nullptr;
+  hierarchicalprior = nullptr;
+  positionprior = nullptr;
+  birthdeathprior = nullptr;
+
+  maxcells = 1000;
+
+  lambda = 1.0;
+
+  seed_base = 983;
+  seed_mult = 101;
+
+  posterior = false;
+
+  Pb = 0.05;
+
+  logspace = false;
+  exact = false;
+  spatialorder = false;
+  weightoperator = false;
+  conditionalvalue = false;
+  conditional = false;
+
+  chains = 1;
+
+  config.total = 1000;
+  config.verbosity = 1000;
+  config.flushinterval = 1000;
+  config.earlyreject = false;
+
+  option_index = 0;
+  while (1) {
+
+    c = getopt_long(argc, argv, short_options, long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+
+    switch (c) {
+
+    case 'i':
+      input = optarg;
+      break;
+
+    case 'I':
+      initial = optarg;
+      break;
+
+    case 'o':
+      output = optarg;
+      break;
+
+    case 'P':
+      prior = optarg;
+      break;
+
+    case 'H':
+      hierarchicalprior = optarg;
+      break;
+
+    case 'M':
+      positionprior = optarg;
+      break;
+
+    case 'B':
+      birthdeathprior = optarg;
+      break;
+
+    case 'T':
+      maxcells = atoi(optarg);
+      if (maxcells < 1) {
+	fprintf(stderr, "error: max cells must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 't':
+      config.total = atoi(optarg);
+      if (config.total < 1) {
+	fprintf(stderr, "error: total must be greater than 0\n");
+	return -1;
+      }
+      break;
+
+    case 'l':
+      lambda = atof(optarg);
+      if (lambda <= 0.0) {
+	fprintf(stderr, "error: lambda must be greater than 0\n");
+	return -1;
+      }
+      break;
+
+    case 'v':
+      config.verbosity = atoi(optarg);
+      if (config.verbosity < 0) {
+	fprintf(stderr, "error: verbosity must be greater than 0\n");
+	return -1;
+      }
+      break;
+
+    case 'b':
+      Pb = atof(optarg);
+      if (Pb < 0.0 || Pb >= 0.5) {
+	fprintf(stderr, "error: Pb must be between 0 and 0.5\n");
+	return -1;
+      }
+      break;
+
+    case 'p':
+      posterior = true;
+      break;
+
+    case 'L':
+      logspace = true;
+      break;
+
+    case 'R':
+      config.earlyreject = true;
+      break;
+
+    case 'E':
+      exact = true;
+      break;
+
+    case 's':
+      spatialorder = true;
+      break;
+
+    case 'w':
+      weightoperator = true;
+      break;
+
+    case 'g':
+      conditionalvalue = true;
+      weightoperator = true;
+      break;
+
+    case 'G':
+      conditional = true;
+      weightoperator = true;
+      break;
+
+    case 'c':
+      chains = atoi(optarg);
+      if (chains <= 0) {
+	fprintf(stderr, "error: no. chains must be greater than 0\n");
+	return -1;
+      }
+      break;
+
+    case 'f':
+      config.flushinterval = atoi(optarg);
+      if (config.flushinterval < 1) {
+	fprintf(stderr, "error: flush interval must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'h':
+    default:
+      usage(argv[0]);
+      return -1;
+
+    }
+  }
+
+  if (input == nullptr) {
+    fprintf(stderr, "error: required parameter input not set\n");
+    return -1;
+  }
+
+  if (weightoperator && exact) {
+    fprintf(stderr, "error: weight operator cannot be combined with exact integration\n");
+    return -1;
+  }
+
+  mkpath(output, "log.txt", filename);
+  if (slog_set_output_file(filename,
+                           SLOG_FLAGS_CLEAR | SLOG_FLAGS_ASYNC) < 0) {
+    fprintf(stderr, "error: failed to redirect log file\n");
+    return -1;
+  }
+
+  //
+  // The first chain loads the data, the others share it read only
+  //
+  std::vector<chain_t> chain(chains);
+
+  for (int i = 0; i < chains; i ++) {
+
+    chain_t &ch = chain[i];
+
+    ch.id = i;
+
+    if (i == 0) {
+      ch.global = new globalS2Voronoi<double>(input,
+					      nullptr,
+					      prior,
+					      hierarchicalprior,
+					      positionprior,
+					      birthdeathprior,
+					      maxcells,
+					      lambda,
+					      1.0, // temperature
+					      seed_base,
+					      posterior,
+					      logspace);
+
+      if (exact && ch.global->data != nullptr) {
+	ch.global->data->set_exact_integration(true);
+      }
+      
+      if (spatialorder && ch.global->data != nullptr) {
+	ch.global->data->spatial_order();
+      }
+    } else {
+      ch.global = new globalS2Voronoi<double>(*chain[0].global, seed_base + seed_mult * i);
+    }
+
+    if (initial != nullptr) {
+      char initial_model_filename[1024];
+      mkrankpath(i, initial, "finalmodel.txt", initial_model_filename);
+      if (!ch.global->model->load(initial_model_filename)) {
+	throw ATTENUATIONEXCEPTION("Failed to load initial model from %s", initial_model_filename);
+      }
+    }
+
+    if (weightoperator) {
+      ch.global->enable_weight_operator();
+    }
+  }
+
+  for (auto &ch : chain) {
+
+    ch.current_likelihood = ch.global->likelihood();
+    INFO("Chain %03d: Initial likelihood: %10.6f\n", ch.id, ch.current_likelihood);
+    ch.global->accept();
+
+    ch.khistogram = new int[maxcells + 1];
+    for (int i = 0; i <= maxcells; i ++) {
+      ch.khistogram[i] = 0;
+    }
+
+    ch.pc = new PerturbationCollectionS2Voronoi<double>();
+    add_perturbations(*ch.pc, *ch.global, posterior, Pb, hierarchicalprior != nullptr, conditionalvalue, conditional);
+
+    mkrankpath(ch.id, output, "ch.dat", filename);
+    ch.history = new chainhistorywriter_t(filename,
+					  *(ch.global->model),
+					  *(ch.global->hierarchical),
+					  ch.current_likelihood);
+  }
+
+  //
+  // The birth/death proposals are shared by the chains so a residual mixture is set once
+  // from the initial model of the first chain
+  //
+  chain[0].global->update_birth_proposal();
+
+  //
+  // Run each chain on its own thread with all history output through a single I/O thread
+  //
+  chainhistorymultiplexer_t *mux = new chainhistorymultiplexer_t();
+  std::vector<std::thread> threads;
+
+  config.output = output;
+
+  for (auto &ch : chain) {
+    threads.push_back(std::thread(run_chain, std::ref(ch), std::cref(config), std::ref(*mux)));
+  }
+
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  mux->finish();
+  delete mux;
+
+  mkpath(output, "instrumentation.txt", filename);
+  INSTRUMENT_WRITE_COMBINED(filename);
+
+  for (auto &ch : chain) {
+    if (ch.error) {
+      std::rethrow_exception(ch.error);
+    }
+  }
+
+  for (auto &ch : chain) {
+
+    //
+    // Save khistogram
+    //
+    mkrankpath(ch.id, output, "khistogram.txt", filename);
+    FILE *fp = fopen(filename, "w");
+    for (int i = 0; i <= maxcells; i ++) {
+      fprintf(fp, "%d %d\n", i, ch.khistogram[i]);
+    }
+    fclose(fp);
+    delete [] ch.khistogram;
+
+    delete ch.history;
+
+    mkrankpath(ch.id, output, "finalmodel.txt", filename);
+    if (!ch.global->model->save(filename)) {
+      throw ATTENUATIONEXCEPTION("Failed to save final model\n");
+    }
+
+    //
+    // Save residuals
+    //
+    mkrankpath(ch.id, output, "residuals.txt", filename);
+    fp = fopen(filename, "w");
+    const double *mean_residuals = ch.global->get_mean_residuals();
+    for (int i = 0; i < ch.global->residual_size; i ++) {
+      fprintf(fp, "%.9g\n", mean_residuals[i]);
+    }
+    fclose(fp);
+
+    delete ch.pc;
+  }
+
+  //
+  // The replicas share the data and priors of the first chain so it is freed last
+  //
+  for (int i = (int)chain.size() - 1; i >= 0; i --) {
+    delete chain[i].global;
+  }
+
+  return 0;
+}
+
+static void run_chain(chain_t &chain, const chain_config_t &config, chainhistorymultiplexer_t &mux)
+{
+  globalS2Voronoi<double> *global = chain.global;
+  PerturbationCollectionS2Voronoi<double> &pc = *chain.pc;
+  std::vector<PerturbationS2Voronoi<double>::delta_t*> steps;
+
+  try {
+
+    for (int i = 0; i < config.total; i ++) {
+
+      double log_prior_ratio;
+      double log_proposal_ratio;
+      PerturbationS2Voronoi<double>::delta_t *perturbation = nullptr;
+
+      if (pc.propose(*global, log_prior_ratio, perturbation)) {
+
+	if (perturbation == nullptr) {
+	  throw ATTENUATIONEXCEPTION("Valid proposal has null perturbation\n");
+	}
+
+	double u = log(global->random.uniform());
+
+	double proposed_likelihood;
+	bool complete = true;
+
+	log_proposal_ratio = pc.log_proposal_ratio(*global);
+
+	INSTRUMENT_START(LIKELIHOOD);
+	if (config.earlyreject) {
+	  proposed_likelihood = global->likelihood(chain.current_likelihood + log_prior_ratio + log_proposal_ratio - u,
+						   complete);
+	} else {
+	  proposed_likelihood = global->likelihood();
+	}
+	INSTRUMENT_END(LIKELIHOOD);
+
+	perturbation->set_proposed_likelihood(proposed_likelihood);
+
+	INSTRUMENT_START(ACCEPT);
+	if (complete &&
+	    u < (chain.current_likelihood - proposed_likelihood + log_prior_ratio + log_proposal_ratio)) {
+
+	  pc.accept(*global);
+	  perturbation->accept();
+	  global->accept();
+
+	  chain.current_likelihood = proposed_likelihood;
+	} else {
+	  pc.reject(*global);
+	  perturbation->reject();
+	  global->reject();
+	}
+	INSTRUMENT_END(ACCEPT);
+      }
+
+      if (config.verbosity > 0 && (i + 1) % config.verbosity == 0) {
+
+	std::string report = pc.generateacceptancereport();
+
+	std::lock_guard<std::mutex> lock(log_mutex);
+	INFO("Chain %03d: %5d: Cells %d Likelihood %10.6f Lambda %10.6f\n",
+	     chain.id,
+	     i + 1,
+	     global->model->ncells(),
+	     chain.current_likelihood,
+	     global->hierarchical->get(0));
+	INFO("%s", report.c_str());
+      }
+
+      int k = global->model->ncells();
+      if (k < 1 || k > global->maxcells) {
+	throw ATTENUATIONEXCEPTION("k out of range: %d (%d)\n", k, global->maxcells);
+      }
+      chain.khistogram[k] ++;
+
+      INSTRUMENT_START(HISTORY);
+      steps.push_back(perturbation);
+      if ((int)steps.size() >= config.flushinterval) {
+	mux.submit(chain.history, steps);
+      }
+      INSTRUMENT_END(HISTORY);
+    }
+
+    mux.submit(chain.history, steps);
+
+    //
+    // The timers are per thread, so per chain, and are also merged for a combined summary
+    //
+    char filename[1024];
+    mkrankpath(chain.id, config.output, "instrumentation.txt", filename);
+    INSTRUMENT_WRITE(filename);
+    INSTRUMENT_MERGE();
+
+  } catch (...) {
+    chain.error = std::current_exception();
+  }
+}
+
+static void add_perturbations(PerturbationCollectionS2Voronoi<double> &pc,
+			      globalS2Voronoi<double> &global,
+			      bool posterior,
+			      double Pb,
+			      bool hierarchical,
+			      bool conditionalvalue,
+			      bool conditional)
+{
+  if (posterior) {
+    pc.add(new ValueS2Voronoi<double>(), 0.1);
+
+    pc.add(new BirthGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+					     global.birthdeathpositionproposal), 1.0);
+    pc.add(new DeathGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+					     global.birthdeathpositionproposal), 1.0);
+  } else {
+    if (conditionalvalue) {
+      pc.add(new ConditionalValueS2Voronoi<double>(global), 1.0);
+    } else {
+      pc.add(new ValueS2Voronoi<double>(), 1.0);
+    }
+
+    if (Pb > 0.0) {
+      pc.add(new MoveS2Voronoi<double>(), 0.5);
+
+      if (conditional) {
+	pc.add(new BirthConditionalS2Voronoi<double>(global), Pb);
+	pc.add(new DeathConditionalS2Voronoi<double>(global), Pb);
+      } else {
+	pc.add(new BirthGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+						 global.birthdeathpositionproposal), Pb);
+	pc.add(new DeathGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+						 global.birthdeathpositionproposal), Pb);
+      }
+    }
+
+    if (hierarchical) {
+      pc.add(new HierarchicalS2Voronoi<double>(), 0.5);
+    }
+  }
+}
+
+static void usage(const char *pname)
+{
+  fprintf(stderr,
+	  "usage: %s [options]\n"
+	  "where options is one or more of:\n"
+	  "\n"
+	  " -i|--input <filename>                   Observations input file\n"
+	  " -I|--initial <path>                     Path of initial models from a previous run\n"
+	  " -o|--output <path>                      Path/prefix for output files\n"
+	  "\n"
+	  " -P|--prior <filename>                   Prior input file\n"
+	  " -H|--hierarchical-prior <filename>      Hierarchical prior input file\n"
+	  " -M|--move-prior <filename>              Move prior input file\n"
+	  " -B|--birth-death-prior <filename>       Birth/Death proposal file\n"
+	  "\n"
+	  " -t|--total <int>                        Total number of iterations\n"
+	  " -v|--verbosity <int>                    Number of iterations between status updates (0 = none)\n"
+	  "\n"
+	  " -l|--lambda <float>                     Initial/fixed lambda parameter\n"
+	  "\n"
+	  " -L|--logspace                           Model is in log(Q)\n"
+	  " -R|--early-reject                       Stop likelihood evaluation once rejection is certain\n"
+	  " -E|--exact-integration                  Integrate t* exactly through the Voronoi cells\n"
+	  " -s|--spatial-order                      Order the paths along a space filling curve\n"
+	  " -w|--weight-operator                    Update predictions incrementally with the path/cell weights\n"
+	  " -g|--conditional-value                  Propose cell values from their approximate conditional (implies -w)\n"
+	  " -G|--conditional-birth-death            Birth values from their approximate conditional (implies -w)\n"
+	  " -T|--max-cells <int>                    Max no. Voronoi cells\n"
+	  " -b|--birth-probability <float>          Relative probability of birth\n"
+	  " -p|--posterior                          Posterior test\n"
+	  "\n"
+	  " -c|--chains <int>                       No. of chains (threads) to run\n"
+	  " -f|--flush-interval <int>               No. of steps between chain history writes\n"
+	  "\n"
+	  " -h|--help                               Usage information\n"
+	  "\n",
+	  pname);
+
+}
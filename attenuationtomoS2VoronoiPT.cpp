@@ -35,16 +35,21 @@
 
 #include "perturbationcollectionS2Voronoi.hpp"
 #include "valueS2Voronoi.hpp"
+#include "conditionalvalueS2Voronoi.hpp"
+#include "birthconditionalS2Voronoi.hpp"
+#include "deathconditionalS2Voronoi.hpp"
+#include "convergencemonitor.hpp"
 #include "birthgenericS2Voronoi.hpp"
 #include "deathgenericS2Voronoi.hpp"
 #include "moveS2Voronoi.hpp"
 #include "hierarchicalS2Voronoi.hpp"
 
+#include "instrumentation.hpp"
 #include "pathutil.hpp"
 
 typedef chainhistorywriterVoronoi<sphericalcoordinate<double>, double> chainhistorywriter_t;
 
-static char short_options[] = "i:I:o:P:H:M:B:D:T:S:t:l:v:b:pLc:K:h";
+static char short_options[] = "i:I:o:P:H:M:B:D:T:S:t:l:v:b:pLRC:A:EswgGk:e:r:a:q:c:K:Y:h";
 static struct option long_options[] = {
   {"input", required_argument, 0, 'i'},
   {"initial", required_argument, 0, 'I'},
@@ -65,14 +70,34 @@ static struct option long_options[] = {
   {"birth-probability", required_argument, 0, 'b'},
   {"posterior", no_argument, 0, 'p'},
   {"logspace", no_argument, 0, 'L'},
+  {"early-reject", no_argument, 0, 'R'},
+  {"exact-integration", no_argument, 0, 'E'},
+  {"spatial-order", no_argument, 0, 's'},
+  {"weight-operator", no_argument, 0, 'w'},
+  {"conditional-value", no_argument, 0, 'g'},
+  {"conditional-birth-death", no_argument, 0, 'G'},
+  {"check-interval", required_argument, 0, 'k'},
+  {"target-ess", required_argument, 0, 'e'},
+  {"target-rhat", required_argument, 0, 'r'},
+  {"adapt", required_argument, 0, 'a'},
+  {"target-acceptance", required_argument, 0, 'q'},
+  {"early-reject-checks", required_argument, 0, 'C'},
+  {"delayed-acceptance", required_argument, 0, 'A'},
 
   {"chains", required_argument, 0, 'c'},
   {"temperatures", required_argument, 0, 'K'},
+
+  {"trace", required_argument, 0, 'Y'},
   
   {"help", no_argument, 0, 'h'},
   {0, 0, 0, 0}
 };
 
+//
+// Iterations between adjustments of the proposal widths during adaptive burn in
+//
+static const int ADAPTATION_INTERVAL = 100;
+
 static void usage(const char *pname);
 
 int main(int argc, char *argv[])
@@ -108,9 +133,25 @@ int main(int argc, char *argv[])
   double Pm;
   bool logspace;
 
+  bool earlyreject;
+  bool exact;
+  bool spatialorder;
+  bool weightoperator;
+  bool conditionalvalue;
+  bool conditional;
+  int checkinterval;
+  double targetess;
+  double targetrhat;
+  int adapt;
+  double targetacceptance;
+  int earlyrejectchecks;
+  int delayedacceptance;
+
   int chains;
   int temperatures;
   double max_temperature;
+
+  int trace;
   
   //
   // State
@@ -118,6 +159,8 @@ int main(int argc, char *argv[])
   globalS2Voronoi<double> *global;
   
   double current_likelihood;
+  double current_surrogate;
+  int screened_out;
 
   //
   // Misc
@@ -161,6 +204,21 @@ int main(int argc, char *argv[])
 
   logspace = false;
 
+  earlyreject = false;
+  exact = false;
+  spatialorder = false;
+  weightoperator = false;
+  conditionalvalue = false;
+  conditional = false;
+  checkinterval = 0;
+  targetess = 0.0;
+  targetrhat = 1.05;
+  adapt = 0;
+  targetacceptance = 0.3;
+  earlyrejectchecks = 8;
+  delayedacceptance = 0;
+  trace = 0;
+
   chains = 1;
   temperatures = 1;
   max_temperature = 1000.0;
@@ -251,6 +309,88 @@ int main(int argc, char *argv[])
       logspace = true;
       break;
 
+    case 'R':
+      earlyreject = true;
+      break;
+
+    case 'E':
+      exact = true;
+      break;
+
+    case 's':
+      spatialorder = true;
+      break;
+
+    case 'w':
+      weightoperator = true;
+      break;
+
+    case 'g':
+      conditionalvalue = true;
+      weightoperator = true;
+      break;
+
+    case 'G':
+      conditional = true;
+      weightoperator = true;
+      break;
+
+    case 'k':
+      checkinterval = atoi(optarg);
+      if (checkinterval < 0) {
+	fprintf(stderr, "error: check interval must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'e':
+      targetess = atof(optarg);
+      if (targetess < 0.0) {
+	fprintf(stderr, "error: target ess must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'r':
+      targetrhat = atof(optarg);
+      if (targetrhat < 1.0) {
+	fprintf(stderr, "error: target rhat must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'a':
+      adapt = atoi(optarg);
+      if (adapt < 0) {
+	fprintf(stderr, "error: adaptation iterations must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'q':
+      targetacceptance = atof(optarg);
+      if (targetacceptance <= 0.0 || targetacceptance >= 1.0) {
+	fprintf(stderr, "error: target acceptance must be between 0 and 1\n");
+	return -1;
+      }
+      break;
+
+    case 'C':
+      earlyrejectchecks = atoi(optarg);
+      if (earlyrejectchecks < 1) {
+	fprintf(stderr, "error: no. early rejection checks must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'A':
+      delayedacceptance = atoi(optarg);
+      if (delayedacceptance < 0) {
+	fprintf(stderr, "error: delayed acceptance stride must be 0 or greater\n");
+	return -1;
+      }
+      break;
+
     case 'c':
       chains = atoi(optarg);
       if (chains <= 0) {
@@ -258,6 +398,18 @@ int main(int argc, char *argv[])
 	return -1;
       }
       break;
+
+    case 'Y':
+      trace = atoi(optarg);
+      if (trace < 0) {
+	fprintf(stderr, "error: no. trace spans must be 0 or greater\n");
+	return -1;
+      }
+      if (trace > 0 && !INSTRUMENT_ENABLED) {
+	fprintf(stderr, "error: tracing requires compiling with -DINSTRUMENTATION\n");
+	return -1;
+      }
+      break;
       
     case 'h':
     default:
@@ -272,6 +424,15 @@ int main(int argc, char *argv[])
     return -1;
   }
 
+  if (targetess > 0.0 && checkinterval == 0) {
+    checkinterval = 1000;
+  }
+
+  if (weightoperator && exact) {
+    fprintf(stderr, "error: weight operator cannot be combined with exact integration\n");
+    return -1;
+  }
+
   if (mpi_size % chains != 0) {
     fprintf(stderr, "error: no. chains (%d) must be a divisor of MPI processes (%d)\n",
 	    chains,
@@ -281,11 +442,15 @@ int main(int argc, char *argv[])
   
   mkrankpath(mpi_rank, output, "log.txt", filename);
   if (slog_set_output_file(filename,
-                           SLOG_FLAGS_CLEAR) < 0) {
+                           SLOG_FLAGS_CLEAR | SLOG_FLAGS_ASYNC) < 0) {
     fprintf(stderr, "error: failed to redirect log file\n");
     return -1;
   }
 
+  if (trace > 0) {
+    INSTRUMENT_TRACE(MPI_COMM_WORLD, trace);
+  }
+
   MPI_Comm chain_communicator;
   double temperature;
   int chain_rank;
@@ -330,27 +495,60 @@ int main(int argc, char *argv[])
 				       posterior,
 				       logspace);
 
-  ValueS2Voronoi<double> *value = new ValueS2Voronoi<double>();
+  if (exact && global->data != nullptr) {
+    global->data->set_exact_integration(true);
+  }
+
+  if (spatialorder && global->data != nullptr) {
+    global->data->spatial_order();
+  }
+
+  PerturbationS2Voronoi<double> *value;
+  if (conditionalvalue && !posterior) {
+    value = new ConditionalValueS2Voronoi<double>(*global);
+  } else {
+    value = new ValueS2Voronoi<double>();
+  }
   MoveS2Voronoi<double> *move = new MoveS2Voronoi<double>();
-  BirthGenericS2Voronoi<double> *birth = new BirthGenericS2Voronoi<double>(global->birthdeathvalueproposal,
-									   global->birthdeathpositionproposal);
-  DeathGenericS2Voronoi<double> *death = new DeathGenericS2Voronoi<double>(global->birthdeathvalueproposal,
-									   global->birthdeathpositionproposal);
+  PerturbationS2Voronoi<double> *birth;
+  PerturbationS2Voronoi<double> *death;
+  if (conditional && !posterior) {
+    birth = new BirthConditionalS2Voronoi<double>(*global);
+    death = new DeathConditionalS2Voronoi<double>(*global);
+  } else {
+    birth = new BirthGenericS2Voronoi<double>(global->birthdeathvalueproposal,
+					      global->birthdeathpositionproposal);
+    death = new DeathGenericS2Voronoi<double>(global->birthdeathvalueproposal,
+					      global->birthdeathpositionproposal);
+  }
   
   global->initialize_mpi(chain_communicator, temperature);
+  global->early_rejection_checks = earlyrejectchecks;
+  if (weightoperator) {
+    global->enable_weight_operator();
+  }
   value->initialize_mpi(chain_communicator);
   move->initialize_mpi(chain_communicator);
   birth->initialize_mpi(chain_communicator);
   death->initialize_mpi(chain_communicator);
 
+  current_surrogate = 0.0;
+  screened_out = 0;
+  if (delayedacceptance > 0) {
+    global->surrogate_stride = delayedacceptance;
+    current_surrogate = global->surrogate_likelihood();
+  }
+
   current_likelihood = global->likelihood();
   if (chain_rank == 0) {
     INFO("Chain %03d: Initial likelihood: %10.6f\n", chain_id, current_likelihood);
   }
   global->accept();
+  global->update_birth_proposal();
 
   int *khistogram = nullptr;
   chainhistorywriter_t *history = nullptr;
+  convergencemonitor monitor(hierarchicalprior != nullptr);
   
   if (chain_rank == 0) {
     khistogram = new int[global->maxcells + 1];
@@ -399,6 +597,12 @@ int main(int argc, char *argv[])
     // Add PT Exchanges if required
     //
   }
+
+  //
+  // The sampling loop is timed for scaling measurements
+  //
+  int completed = total;
+  double loop_start = MPI_Wtime();
   
   for (int i = 0; i < total; i ++) {
     
@@ -409,21 +613,90 @@ int main(int argc, char *argv[])
     
     if (pc.propose(*global, log_prior_ratio, perturbation)) {
 
-      double proposed_likelihood = global->likelihood();
+      double proposed_likelihood;
+      double proposed_surrogate = 0.0;
+      double log_ratio = 0.0;
+      bool complete = true;
+      bool screened = true;
+      double u = 0.0;
+
+      if (delayedacceptance > 0) {
+	//
+	// First stage screens the proposal using the surrogate likelihood. Survivors are then
+	// accepted with the ratio of the full to surrogate likelihood ratios which corrects
+	// for the approximation so that the posterior is unchanged.
+	//
+	INSTRUMENT_START(LIKELIHOOD);
+	proposed_surrogate = global->surrogate_likelihood();
+	INSTRUMENT_END(LIKELIHOOD);
+	
+	if (chain_rank == 0) {
+	  u = log(global->random.uniform());
+	  log_proposal_ratio = pc.log_proposal_ratio(*global);
+
+	  screened = u < (current_surrogate - proposed_surrogate + log_prior_ratio + log_proposal_ratio);
+	  if (screened) {
+	    u = log(global->random.uniform());
+	  } else {
+	    screened_out ++;
+	  }
+	  
+	  log_ratio = proposed_surrogate - current_surrogate;
+	}
+
+	int t = screened;
+	INSTRUMENT_START(COLLECTIVE);
+	MPI_Bcast(&t, 1, MPI_INT, 0, chain_communicator);
+	INSTRUMENT_END(COLLECTIVE);
+	screened = t;
+	
+      } else if (earlyreject && chain_rank == 0) {
+	u = log(global->random.uniform());
+	log_proposal_ratio = pc.log_proposal_ratio(*global);
+	log_ratio = log_prior_ratio + log_proposal_ratio;
+      }
+
+      if (!screened) {
+	proposed_likelihood = proposed_surrogate;
+      } else if (earlyreject) {
+	//
+	// The acceptance threshold is computed on the primary and shared so that all
+	// processes in the chain can abandon the likelihood once rejection is certain.
+	//
+	double threshold = 0.0;
+	if (chain_rank == 0) {
+	  threshold = current_likelihood + log_ratio - u;
+	}
+	INSTRUMENT_START(COLLECTIVE);
+	MPI_Bcast(&threshold, 1, MPI_DOUBLE, 0, chain_communicator);
+	INSTRUMENT_END(COLLECTIVE);
+
+	INSTRUMENT_START(LIKELIHOOD);
+	proposed_likelihood = global->likelihood(threshold, complete);
+	INSTRUMENT_END(LIKELIHOOD);
+	
+      } else {
+	INSTRUMENT_START(LIKELIHOOD);
+	proposed_likelihood = global->likelihood();
+	INSTRUMENT_END(LIKELIHOOD);
+      }
       
       if (chain_rank == 0) {
 	
 	if (perturbation == nullptr) {
 	  throw ATTENUATIONEXCEPTION("Valid proposal has null perturbation\n");
 	}
-	
-	double u = log(global->random.uniform());
+
+	if (delayedacceptance == 0 && !earlyreject) {
+	  u = log(global->random.uniform());
+	  log_proposal_ratio = pc.log_proposal_ratio(*global);
+	  log_ratio = log_prior_ratio + log_proposal_ratio;
+	}
 	
 	perturbation->set_proposed_likelihood(proposed_likelihood);
 	
-	log_proposal_ratio = pc.log_proposal_ratio(*global);
-	
-	accepted = u < (current_likelihood - proposed_likelihood + log_prior_ratio + log_proposal_ratio);
+	accepted = screened && complete &&
+	  (u < (current_likelihood - proposed_likelihood + log_ratio));
 
 	if (accepted) {
 	  perturbation->accept();
@@ -433,17 +706,22 @@ int main(int argc, char *argv[])
       }
 
       int t = accepted;
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(&t, 1, MPI_INT, 0, chain_communicator);
+      INSTRUMENT_END(COLLECTIVE);
       accepted = t;
 
+      INSTRUMENT_START(ACCEPT);
       if (accepted) {
 	pc.accept(*global);
 	current_likelihood = proposed_likelihood;
+	current_surrogate = proposed_surrogate;
 	global->accept();
       } else {
 	pc.reject(*global);
 	global->reject();
       }
+      INSTRUMENT_END(ACCEPT);
     }
 
     if (chain_rank == 0) {
@@ -457,6 +735,10 @@ int main(int argc, char *argv[])
 
 	std::string report = pc.generateacceptancereport();
 	INFO("%s", report.c_str());
+
+	if (delayedacceptance > 0) {
+	  INFO("Screened out: %d\n", screened_out);
+	}
       }
       
       int k = global->model->ncells();
@@ -465,11 +747,78 @@ int main(int argc, char *argv[])
       }
       khistogram[k] ++;
       
+      INSTRUMENT_START(HISTORY);
       history->add(perturbation);
+      INSTRUMENT_END(HISTORY);
+
+      if (checkinterval > 0) {
+	monitor.add(current_likelihood, k, global->hierarchical->get(0));
+      }
+    }
+
+    if (i < adapt) {
+      //
+      // Each chain tunes its own proposal widths and residual birth proposal (if any)
+      // during burn in then fixes them from here
+      // on so that the remainder of the chain samples its target distribution
+      //
+      if ((i + 1) % ADAPTATION_INTERVAL == 0) {
+	pc.adapt(*global, targetacceptance);
+	global->update_birth_proposal();
+      }
+
+      if (i + 1 == adapt && chain_rank == 0) {
+	std::vector<std::string> names;
+	std::vector<double> scales;
+
+	pc.adaptation(*global, names, scales);
+	history->add(new adaptation_deltaVoronoi<sphericalcoordinate<double>, double>(names, scales));
+
+	INFO("Adapted proposals after %d iterations\n%s", i + 1, pc.generateadaptationreport(*global).c_str());
+      }
+    }
+
+    if (checkinterval > 0 && (i + 1) % checkinterval == 0) {
+      //
+      // Only the unheated chains sample the posterior. The diagnostics are combined over
+      // all processes so that every chain stops at the same iteration.
+      //
+      convergencemonitor::diagnostics_t d;
+      convergencemonitor::combine(MPI_COMM_WORLD,
+				  (chain_rank == 0 && temperature == 1.0) ? &monitor : nullptr,
+				  d);
+
+      if (mpi_rank == 0) {
+	for (int s = 0; s < convergencemonitor::NSERIES; s ++) {
+	  INFO("%5d: %10s ESS %10.1f IAT %10.2f R-hat %8.4f (%d chains)\n",
+	       i + 1,
+	       convergencemonitor::name(s),
+	       d.ess[s],
+	       d.iat[s],
+	       d.rhat[s],
+	       d.chains);
+	}
+      }
+
+      if (targetess > 0.0 && convergencemonitor::converged(d, targetess, targetrhat)) {
+	if (chain_rank == 0) {
+	  INFO("Chain %03d: Converged after %d iterations\n", chain_id, i + 1);
+	}
+	completed = i + 1;
+	break;
+      }
     }
   }
 
+  double loop_time = MPI_Wtime() - loop_start;
+  
   if (chain_rank == 0) {
+    INFO("Chain %03d: %d iterations in %.3f seconds (%.3f iterations/second)\n",
+	 chain_id,
+	 completed,
+	 loop_time,
+	 (double)completed/loop_time);
+    
     //
     // Save khistogram
     //
@@ -495,13 +844,27 @@ int main(int argc, char *argv[])
     //
     mkrankpath(chain_id, output, "residuals.txt", filename);
     fp = fopen(filename, "w");
+    const double *mean_residuals = global->get_mean_residuals();
     for (int i = 0; i < global->residual_size; i ++) {
-      fprintf(fp, "%.9g\n", global->mean_residuals[i]);
+      fprintf(fp, "%.9g\n", mean_residuals[i]);
     }
     fclose(fp);
       
   }
 
+  //
+  // Every process times its own share of the work
+  //
+  mkrankpath(mpi_rank, output, "instrumentation.txt", filename);
+  INSTRUMENT_WRITE(filename);
+
+  if (trace > 0) {
+    mkpath(output, "trace.json", filename);
+    INSTRUMENT_WRITE_TRACE(MPI_COMM_WORLD, filename);
+  }
+
+  delete global;
+
   MPI_Finalize();
 
   return 0;
@@ -527,13 +890,29 @@ static void usage(const char *pname)
 	  "\n"
 	  " -l|--lambda <float>                     Initial/fixed lambda parameter\n"
 	  "\n"
+	  " -k|--check-interval <int>               Iterations between convergence diagnostics (0 = none)\n"
+	  " -e|--target-ess <float>                 Stop once the pooled effective sample size reaches this (0 = run to total)\n"
+	  " -r|--target-rhat <float>                Stop only once R-hat across the unheated chains is below this (default 1.05)\n"
+	  " -a|--adapt <int>                        Burn in iterations over which proposal widths are tuned (0 = off)\n"
+	  " -q|--target-acceptance <float>          Acceptance rate the proposal widths are tuned toward (default 0.3)\n"
 	  " -T|--max-cells <int>                    Max no. Voronoi cells\n"
 	  " -b|--birth-probability <float>          Relative probability of birth\n"
 	  " -p|--posterior                          Posterior test\n"
 	  "\n"
+	  " -R|--early-reject                       Stop likelihood evaluation once rejection is certain\n"
+	  " -E|--exact-integration                  Integrate t* exactly through the Voronoi cells\n"
+	  " -s|--spatial-order                      Order the paths along a space filling curve\n"
+	  " -w|--weight-operator                    Update predictions incrementally with the path/cell weights\n"
+	  " -g|--conditional-value                  Propose cell values from their approximate conditional (implies -w)\n"
+	  " -G|--conditional-birth-death            Birth values from their approximate conditional (implies -w)\n"
+	  " -C|--early-reject-checks <int>          No. of combined checks per likelihood evaluation\n"
+	  " -A|--delayed-acceptance <int>           Screen proposals with every nth path first (0 = off)\n"
+	  "\n"
 	  " -c|--chains <int>                       No. of chains to run\n"
 	  " -K|--temperatures <int>                 No. of temperatures to run\n"
 	  "\n"
+	  " -Y|--trace <int>                        Max. timed spans per process to write to trace.json (0 = off)\n"
+	  "\n"
 	  " -h|--help                               Usage information\n"
 	  "\n",
 	  pname);
@@ -0,0 +1,797 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+//
+// Micro benchmarks of the kernels that dominate an iteration of the sampler: point location,
+// the forward model and likelihood, each perturbation's propose/accept/reject cycle and the
+// chain history. Each benchmark is calibrated to run for at least the minimum time, then
+// repeated and the median time and number of (C++) heap allocations per operation reported.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "attenuationdataS2.hpp"
+#include "chainhistoryVoronoi.hpp"
+#include "globalS2Voronoi.hpp"
+
+#include "perturbationcollectionS2Voronoi.hpp"
+#include "staticperturbationcollectionS2Voronoi.hpp"
+#include "valueS2Voronoi.hpp"
+#include "birthgenericS2Voronoi.hpp"
+#include "deathgenericS2Voronoi.hpp"
+#include "moveS2Voronoi.hpp"
+#include "hierarchicalS2Voronoi.hpp"
+
+#include "pathutil.hpp"
+#include "syntheticgeometry.hpp"
+
+extern "C" {
+  #include "slog.h"
+};
+
+//
+// Every allocation through the global operator new is counted. All forms of operator delete
+// are replaced as well so that every allocation is matched by a free.
+//
+static std::atomic<long> allocations(0);
+
+static void *counted_malloc(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new(size_t size)
+{
+  return counted_malloc(size);
+}
+
+void *operator new[](size_t size)
+{
+  return counted_malloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+
+typedef sphericalcoordinate<double> coord_t;
+typedef deltaVoronoi<coord_t, double> delta_t;
+typedef model_deltaVoronoi<coord_t, double> model_delta_t;
+typedef chainhistorywriterVoronoi<coord_t, double> chainhistorywriter_t;
+typedef chainhistoryreaderVoronoi<coord_t, double> chainhistoryreader_t;
+
+static const int REPETITIONS = 5;
+static const int INITIAL_CELLS = 50;
+static const int MAXCELLS = 1000;
+
+class benchmarkrunner {
+public:
+
+  struct result_t {
+    std::string name;
+    long iterations;
+    double ns_per_op;
+    double allocs_per_op;
+  };
+
+  benchmarkrunner(double _min_time, const char *_filter) :
+    min_time(_min_time),
+    filter(_filter)
+  {
+  }
+
+  //
+  // Run f(n), which performs n operations, if name matches the filter
+  //
+  void run(const std::string &name, const std::function<void(long)> &f)
+  {
+    if (filter != nullptr && name.find(filter) == std::string::npos) {
+      return;
+    }
+
+    //
+    // Grow the count until a single run takes the minimum time
+    //
+    long n = 1;
+    for (;;) {
+      double t = elapsed(f, n);
+      if (t >= min_time || n >= (1L << 40)) {
+	break;
+      }
+
+      double scale = (t > 0.0) ? 1.2 * min_time/t : 100.0;
+      n = std::max(2 * n, std::min((long)(n * scale), 100 * n));
+    }
+
+    std::vector<std::pair<double, long>> samples;
+    for (int i = 0; i < REPETITIONS; i ++) {
+      long a0 = allocations.load();
+      double t = elapsed(f, n);
+      samples.push_back(std::pair<double, long>(t, allocations.load() - a0));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    result_t r;
+    r.name = name;
+    r.iterations = n;
+    r.ns_per_op = samples[REPETITIONS/2].first * 1.0e9/(double)n;
+    r.allocs_per_op = (double)samples[REPETITIONS/2].second/(double)n;
+    results.push_back(r);
+
+    printf("%-40s %12ld %14.1f %12.2f\n", r.name.c_str(), r.iterations, r.ns_per_op, r.allocs_per_op);
+    fflush(stdout);
+  }
+
+  void header() const
+  {
+    printf("%-40s %12s %14s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+  }
+
+  bool write(const char *filename) const
+  {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+      return false;
+    }
+
+    fprintf(fp, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i ++) {
+      const result_t &r = results[i];
+      fprintf(fp,
+	      "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}%s\n",
+	      r.name.c_str(),
+	      r.iterations,
+	      r.ns_per_op,
+	      r.allocs_per_op,
+	      (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+
+    fclose(fp);
+    return true;
+  }
+  
+private:
+
+  static double elapsed(const std::function<void(long)> &f, long n)
+  {
+    struct timespec t0, t1;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    f(n);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1.0e-9;
+  }
+
+  double min_time;
+  const char *filter;
+  std::vector<result_t> results;
+};
+
+//
+// Results are accumulated here so that the benchmarked work cannot be optimised away
+//
+static volatile double sink;
+
+static const char *PRIOR =
+  "prior LogNormal\n"
+  "5.8 1.0\n"
+  "proposal Gaussian\n"
+  "2.0e1\n";
+
+static const char *POSITION_PRIOR =
+  "sphericalprior UniformSpherical\n"
+  "sphericalproposal VonMisesSpherical\n"
+  "1.0e1\n";
+
+static const char *HIERARCHICAL_PRIOR =
+  "prior Uniform\n"
+  "0.1 5.0\n"
+  "proposal Gaussian\n"
+  "0.05\n";
+
+static char short_options[] = "o:m:f:d:S:h";
+static struct option long_options[] = {
+  {"output", required_argument, 0, 'o'},
+  {"min-time", required_argument, 0, 'm'},
+  {"filter", required_argument, 0, 'f'},
+  {"data", required_argument, 0, 'd'},
+  {"seed", required_argument, 0, 'S'},
+  
+  {"help", no_argument, 0, 'h'},
+  {0, 0, 0, 0}
+};
+
+static void usage(const char *pname);
+
+static bool write_text(const std::string &filename, const char *text);
+static bool read_tstar(const char *filename, std::vector<double> &tstar);
+static void random_model(Rng &random, int ncells, double v, sphericalvoronoimodel<double> &model);
+
+static void bench_nearest(benchmarkrunner &runner, Rng &random);
+static void bench_forward(benchmarkrunner &runner,
+			  Rng &random,
+			  const std::string &name,
+			  const std::string &paths);
+static void bench_perturbations(benchmarkrunner &runner, const std::string &dir, int seed);
+static void bench_history(benchmarkrunner &runner, Rng &random, const std::string &dir);
+
+int main(int argc, char *argv[])
+{
+  int c;
+  int option_index;
+
+  char *output;
+  double min_time;
+  char *filter;
+  char *tstar_file;
+  int seed;
+
+  //
+  // Defaults
+  //
+  output = nullptr;
+  min_time = 0.5;
+  filter = nullptr;
+  tstar_file = (char*)"data/tstar_new.real";
+  seed = 983;
+
+  option_index = 0;
+  while (1) {
+
+    c = getopt_long(argc, argv, short_options, long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+
+    switch (c) {
+
+    case 'o':
+      output = optarg;
+      break;
+
+    case 'm':
+      min_time = atof(optarg);
+      if (min_time <= 0.0) {
+	fprintf(stderr, "error: minimum time must be greater than 0\n");
+	return -1;
+      }
+      break;
+
+    case 'f':
+      filter = optarg;
+      break;
+
+    case 'd':
+      tstar_file = optarg;
+      break;
+
+    case 'S':
+      seed = atoi(optarg);
+      break;
+
+    case 'h':
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  //
+  // Input files are generated in a temporary directory
+  //
+  char dirtemplate[] = "/tmp/benchmarkXXXXXX";
+  if (mkdtemp(dirtemplate) == NULL) {
+    fprintf(stderr, "error: failed to create temporary directory\n");
+    return -1;
+  }
+  std::string dir = dirtemplate;
+  
+  if (slog_set_output_file((dir + "/log.txt").c_str(), SLOG_FLAGS_CLEAR) < 0) {
+    fprintf(stderr, "error: failed to create log file\n");
+    return -1;
+  }
+
+  Rng random(seed);
+  std::vector<std::string> files;
+
+  try {
+
+    //
+    // The observed t* have no path geometry so they are paired with synthetic paths
+    //
+    std::vector<double> tstar;
+    if (!read_tstar(tstar_file, tstar)) {
+      fprintf(stderr, "error: failed to read t* from %s\n", tstar_file);
+      return -1;
+    }
+
+    files.push_back(dir + "/tstar_new.txt");
+    syntheticgeometry::write(files.back().c_str(), tstar, 0.1, syntheticgeometry::DEFAULT_POINTS, random);
+
+    std::vector<std::string> synthetic;
+    for (int n : {1000, 4000}) {
+      files.push_back(dir + "/synthetic_" + std::to_string(n) + ".txt");
+      synthetic.push_back(files.back());
+      
+      syntheticgeometry::write(files.back().c_str(),
+			       std::vector<double>(n, 1.0),
+			       0.1,
+			       syntheticgeometry::DEFAULT_POINTS,
+			       random);
+    }
+
+    benchmarkrunner runner(min_time, filter);
+    runner.header();
+
+    bench_nearest(runner, random);
+    
+    bench_forward(runner, random, "tstar_new", dir + "/tstar_new.txt");
+    bench_forward(runner, random, "synthetic/1000", synthetic[0]);
+    bench_forward(runner, random, "synthetic/4000", synthetic[1]);
+
+    bench_perturbations(runner, dir, seed);
+
+    bench_history(runner, random, dir);
+
+    if (output != nullptr) {
+      if (!runner.write(output)) {
+	fprintf(stderr, "error: failed to write results to %s\n", output);
+	return -1;
+      }
+    }
+    
+  } catch (attenuationexception &e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return -1;
+  }
+
+  slog_close();
+  
+  for (auto &f : files) {
+    unlink(f.c_str());
+  }
+  for (auto f : {"log.txt", "model.txt", "prior.txt", "position_prior.txt", "hierarchical_prior.txt",
+	"write.dat", "read.dat"}) {
+    unlink((dir + "/" + f).c_str());
+  }
+  rmdir(dir.c_str());
+  
+  return 0;
+}
+
+//
+// Nearest cell by exhaustive search and by walking the Delaunay triangulation from the
+// previous cell as is done for consecutive points along a path
+//
+static void bench_nearest(benchmarkrunner &runner, Rng &random)
+{
+  static const int NPOINTS = 4096;
+
+  std::vector<coord_t> points;
+  std::vector<vector3<double>> cartesian;
+  for (int i = 0; i < NPOINTS; i ++) {
+    double phi = acos(2.0 * random.uniform() - 1.0);
+    double theta = (2.0 * random.uniform() - 1.0) * M_PI;
+
+    vector3<double> x;
+    coord_t::sphericaltocartesian(phi, theta, x);
+    
+    points.push_back(coord_t(phi, theta));
+    cartesian.push_back(x);
+  }
+
+  //
+  // Sort along a coarse latitude band sweep so that consecutive points are nearby
+  //
+  std::vector<int> order(NPOINTS);
+  for (int i = 0; i < NPOINTS; i ++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+      int ba = (int)(points[a].phi * 16.0/M_PI);
+      int bb = (int)(points[b].phi * 16.0/M_PI);
+      if (ba != bb) {
+	return ba < bb;
+      }
+      return (ba % 2 == 0) ? (points[a].theta < points[b].theta) : (points[a].theta > points[b].theta);
+    });
+
+  for (int ncells : {10, 100, 1000, 10000}) {
+
+    sphericalvoronoimodel<double> model(false);
+    random_model(random, ncells, 1.0, model);
+
+    runner.run("nearest/" + std::to_string(ncells), [&](long n) {
+	double s = 0.0;
+	for (long i = 0; i < n; i ++) {
+	  coord_t centre;
+	  double v;
+	  model.nearest(points[i % NPOINTS], centre, v);
+	  s += v;
+	}
+	sink = s;
+      });
+
+    model.enable_triangulation();
+    
+    runner.run("nearest/walk/" + std::to_string(ncells), [&](long n) {
+	int hint = 0;
+	double s = 0.0;
+	for (long i = 0; i < n; i ++) {
+	  int j = order[i % NPOINTS];
+	  hint = model.nearest_index(points[j], cartesian[j], hint);
+	  s += hint;
+	}
+	sink = s;
+      });
+  }
+}
+
+//
+// Forward model of a single path and the likelihood of a whole dataset
+//
+static void bench_forward(benchmarkrunner &runner,
+			  Rng &random,
+			  const std::string &name,
+			  const std::string &paths)
+{
+  attenuationdataS2<double> data(paths.c_str());
+  std::vector<double> residuals(data.data.size());
+
+  sphericalvoronoimodel<double> model(false);
+  random_model(random, INITIAL_CELLS, 300.0, model);
+  model.enable_triangulation();
+
+  int npaths = data.data.size();
+  
+  runner.run("predicted_tstar_direct/" + name, [&](long n) {
+      int hint = -1;
+      double s = 0.0;
+      for (long i = 0; i < n; i ++) {
+	s += data.data[i % npaths].predicted_tstar_direct(model, hint);
+      }
+      sink = s;
+    });
+
+  runner.run("likelihood/" + name, [&](long n) {
+      double s = 0.0;
+      for (long i = 0; i < n; i ++) {
+	s += data.likelihood(model, 1.0, residuals.data());
+      }
+      sink = s;
+    });
+}
+
+//
+// Propose, compute the proposal ratio and accept or reject. Accepting births or deaths
+// would change the number of cells over the run so they are always rejected.
+//
+template
+<typename P>
+static void bench_perturbation(benchmarkrunner &runner,
+			       globalS2Voronoi<double> &global,
+			       P &p,
+			       bool alternate)
+{
+  runner.run(std::string("perturbation/") + p.displayname(), [&](long n) {
+      double s = 0.0;
+      for (long i = 0; i < n; i ++) {
+	double log_prior_ratio;
+	delta_t *delta = nullptr;
+	
+	if (p.propose(MAXCELLS,
+		      global.data->data.size(),
+		      global.random,
+		      *global.prior,
+		      *global.positionprior,
+		      *global.model,
+		      *global.hierarchicalprior,
+		      *global.hierarchical,
+		      global.temperature,
+		      log_prior_ratio,
+		      delta)) {
+	  
+	  s += p.log_proposal_ratio(global.random,
+				    *global.prior,
+				    *global.positionprior,
+				    *global.model,
+				    *global.hierarchicalprior,
+				    *global.hierarchical,
+				    global.temperature);
+
+	  if (alternate && (i % 2) == 0) {
+	    p.accept();
+	    delta->accept();
+	  } else {
+	    p.reject(*global.model);
+	    delta->reject();
+	  }
+	}
+
+	delete delta;
+      }
+      sink = s;
+    });
+}
+
+template
+<typename collection>
+static void bench_collection(benchmarkrunner &runner,
+			     const char *name,
+			     globalS2Voronoi<double> &global,
+			     collection &pc)
+{
+  runner.run(std::string("collection/") + name, [&](long n) {
+      double s = 0.0;
+      for (long i = 0; i < n; i ++) {
+	double log_prior_ratio;
+	delta_t *delta = nullptr;
+	
+	if (pc.propose(global, log_prior_ratio, delta)) {
+	  s += pc.log_proposal_ratio(global);
+	  pc.reject(global);
+	  delta->reject();
+	}
+
+	delete delta;
+      }
+      sink = s;
+    });
+}
+
+static void bench_perturbations(benchmarkrunner &runner, const std::string &dir, int seed)
+{
+  std::string model_file = dir + "/model.txt";
+  std::string prior_file = dir + "/prior.txt";
+  std::string position_prior_file = dir + "/position_prior.txt";
+  std::string hierarchical_prior_file = dir + "/hierarchical_prior.txt";
+
+  if (!write_text(prior_file, PRIOR) ||
+      !write_text(position_prior_file, POSITION_PRIOR) ||
+      !write_text(hierarchical_prior_file, HIERARCHICAL_PRIOR)) {
+    throw ATTENUATIONEXCEPTION("Failed to write prior files\n");
+  }
+
+  Rng random(seed);
+  sphericalvoronoimodel<double> initial(false);
+  random_model(random, INITIAL_CELLS, 300.0, initial);
+  if (!initial.save(model_file.c_str())) {
+    throw ATTENUATIONEXCEPTION("Failed to write initial model\n");
+  }
+  
+  globalS2Voronoi<double> global((dir + "/synthetic_1000.txt").c_str(),
+				 model_file.c_str(),
+				 prior_file.c_str(),
+				 hierarchical_prior_file.c_str(),
+				 position_prior_file.c_str(),
+				 nullptr,
+				 MAXCELLS,
+				 1.0,
+				 1.0,
+				 seed,
+				 false,
+				 false);
+
+  ValueS2Voronoi<double> value;
+  MoveS2Voronoi<double> move;
+  BirthGenericS2Voronoi<double> birth(global.birthdeathvalueproposal,
+				      global.birthdeathpositionproposal);
+  DeathGenericS2Voronoi<double> death(global.birthdeathvalueproposal,
+				      global.birthdeathpositionproposal);
+  HierarchicalS2Voronoi<double> hierarchical;
+
+  bench_perturbation(runner, global, value, true);
+  bench_perturbation(runner, global, move, true);
+  bench_perturbation(runner, global, birth, false);
+  bench_perturbation(runner, global, death, false);
+  bench_perturbation(runner, global, hierarchical, true);
+
+  //
+  // Selection and dispatch through the dynamic and static collections with the weights
+  // of the standard perturbations
+  //
+  PerturbationCollectionS2Voronoi<double> dynamic;
+  dynamic.add(new ValueS2Voronoi<double>(), 1.0);
+  dynamic.add(new MoveS2Voronoi<double>(), 0.5);
+  dynamic.add(new BirthGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+						global.birthdeathpositionproposal), 0.05);
+  dynamic.add(new DeathGenericS2Voronoi<double>(global.birthdeathvalueproposal,
+						global.birthdeathpositionproposal), 0.05);
+  bench_collection(runner, "dynamic", global, dynamic);
+
+  StaticPerturbationCollectionS2Voronoi<double,
+					ValueS2Voronoi<double>,
+					MoveS2Voronoi<double>,
+					BirthGenericS2Voronoi<double>,
+					DeathGenericS2Voronoi<double>> fixed({1.0, 0.5, 0.05, 0.05},
+									    value, move, birth, death);
+  bench_collection(runner, "static", global, fixed);
+}
+
+//
+// Writing value changes to the chain history and replaying them
+//
+static void bench_history(benchmarkrunner &runner, Rng &random, const std::string &dir)
+{
+  static const int FLUSH_INTERVAL = 1024;
+  static const int HISTORY_STEPS = 100000;
+  
+  std::string write_file = dir + "/write.dat";
+  std::string read_file = dir + "/read.dat";
+
+  sphericalvoronoimodel<double> model(false);
+  random_model(random, INITIAL_CELLS, 300.0, model);
+  singlescaling_hierarchical_model hierarchical(1.0);
+
+  {
+    chainhistorywriter_t writer(write_file.c_str(), model, hierarchical, 1.0);
+    
+    runner.run("history/write", [&](long n) {
+	for (long i = 0; i < n; i ++) {
+	  model_delta_t *d = model_delta_t::mkvalue(i % INITIAL_CELLS, 300.0, 301.0);
+	  d->set_proposed_likelihood(1.0);
+	  if (i % 2 == 0) {
+	    d->accept();
+	  } else {
+	    d->reject();
+	  }
+	  writer.add(d);
+	  
+	  if ((i + 1) % FLUSH_INTERVAL == 0) {
+	    writer.flush();
+	  }
+	}
+	writer.flush();
+      });
+  }
+
+  {
+    chainhistorywriter_t writer(read_file.c_str(), model, hierarchical, 1.0);
+    for (int i = 0; i < HISTORY_STEPS; i ++) {
+      model_delta_t *d = model_delta_t::mkvalue(i % INITIAL_CELLS, 300.0, 300.0 + (double)i);
+      d->set_proposed_likelihood((double)i);
+      d->accept();
+      writer.add(d);
+    }
+  }
+
+  chainhistoryreader_t *reader = new chainhistoryreader_t(read_file.c_str());
+  
+  runner.run("history/read", [&](long n) {
+      double s = 0.0;
+      for (long i = 0; i < n; i ++) {
+	double likelihood;
+	int r = reader->step(model, hierarchical, likelihood);
+	if (r == 0) {
+	  //
+	  // Start again from the beginning of the history
+	  //
+	  delete reader;
+	  reader = new chainhistoryreader_t(read_file.c_str());
+	  r = reader->step(model, hierarchical, likelihood);
+	}
+
+	if (r < 0) {
+	  throw ATTENUATIONEXCEPTION("Failed to read chain history\n");
+	}
+	s += likelihood;
+      }
+      sink = s;
+    });
+
+  delete reader;
+}
+
+static bool write_text(const std::string &filename, const char *text)
+{
+  FILE *fp = fopen(filename.c_str(), "w");
+  if (fp == NULL) {
+    return false;
+  }
+
+  fputs(text, fp);
+  fclose(fp);
+  return true;
+}
+
+static bool read_tstar(const char *filename, std::vector<double> &tstar)
+{
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    return false;
+  }
+
+  double t;
+  while (fscanf(fp, "%lf", &t) == 1) {
+    tstar.push_back(t);
+  }
+
+  fclose(fp);
+  return tstar.size() > 0;
+}
+
+static void random_model(Rng &random, int ncells, double v, sphericalvoronoimodel<double> &model)
+{
+  for (int i = 0; i < ncells; i ++) {
+    double phi = acos(2.0 * random.uniform() - 1.0);
+    double theta = (2.0 * random.uniform() - 1.0) * M_PI;
+    
+    model.add_cell(coord_t(phi, theta), v);
+  }
+}
+
+static void usage(const char *pname)
+{
+  fprintf(stderr,
+	  "usage: %s [options]\n"
+	  "where options is one or more of\n"
+	  "\n"
+	  " -o | --output <filename>          Write the results as JSON to this file\n"
+	  " -m | --min-time <float>           Minimum time in seconds of each repetition (default 0.5)\n"
+	  " -f | --filter <string>            Only run benchmarks whose name contains this\n"
+	  " -d | --data <filename>            Observed t* to pair with synthetic paths\n"
+	  "                                   (default data/tstar_new.real)\n"
+	  " -S | --seed <int>                 Random seed\n"
+	  "\n"
+	  " -h | --help                       Usage\n"
+	  "\n",
+	  pname);
+}
@@ -0,0 +1,240 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef birthconditionalS2Voronoi_hpp
+#define birthconditionalS2Voronoi_hpp
+
+#include "conditionalvalueproposal.hpp"
+#include "globalS2Voronoi.hpp"
+#include "perturbationS2Voronoi.hpp"
+
+//
+// Birth with the value of the new cell drawn from its conditional posterior given the
+// position and the other cells (see ConditionalValueProposal) rather than blindly from a
+// proposal, so that the acceptance is close to the ratio of the marginal likelihoods with
+// and without the new cell. The position is proposed as in BirthGenericS2Voronoi.
+//
+template
+<typename value>
+class BirthConditionalS2Voronoi : public PerturbationS2Voronoi<value> {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef deltaVoronoi<coord_t, value> delta_t;
+  typedef model_deltaVoronoi<coord_t, value> model_delta_t;
+
+  BirthConditionalS2Voronoi(globalS2Voronoi<value> &_global) :
+    global(_global),
+    undo_available(false),
+    p(0),
+    a(0),
+    last_log_proposal_ratio(0.0)
+  {
+    ConditionalValueProposal::check_prior(*global.prior->get_prior(), global.model->is_logspace());
+  }
+
+  ~BirthConditionalS2Voronoi()
+  {
+  }
+
+  virtual bool propose(int maxcells,
+		       int nobs,
+		       Rng &random,
+		       PriorProposal &prior,
+		       SphericalPriorProposal &position_prior,
+		       sphericalvoronoimodel<value> &model,
+		       PriorProposal &hierarchical_prior,
+		       hierarchical_model &hierarchical,
+		       double temperature,
+		       double &log_prior_ratio,
+		       delta_t *&perturbation)
+  {
+    bool validposition = false;
+    bool validproposal = false;
+    value newvalue = 0.0;
+    coord_t newposition;
+    double logvalueproposal = 0.0;
+
+    if (undo_available) {
+      throw ATTENUATIONEXCEPTION("Proposal in progress\n");
+    }
+
+    if (global.weights == nullptr) {
+      throw ATTENUATIONEXCEPTION("Conditional birth requires the weight operator\n");
+    }
+    
+    if (this->primary()) {
+      p ++;
+      
+      int k = model.ncells();
+    
+      if (k == maxcells) {
+	perturbation = model_delta_t::mkbirth(coord_t(), 0.0);
+      } else {
+
+	value newphi;
+	value newtheta;
+	value logpriorratio;
+	if (!global.birthdeathpositionproposal->propose(random,
+							 temperature,
+							 0.0,
+							 0.0,
+							 newphi,
+							 newtheta,
+							 logpriorratio)) {
+	  perturbation = model_delta_t::mkbirth(coord_t(), 0.0);
+	} else {
+	  newposition = coord_t(newphi, newtheta);
+	  validposition = true;
+	}
+      }
+    }
+
+    this->communicate(validposition);
+    if (!validposition) {
+      return false;
+    }
+
+    this->communicate(newposition);
+
+    //
+    // Insert the cell with the value at its position, which leaves the predictions
+    // unchanged, to obtain the moments of its likelihood
+    //
+    int index = model.ncells();
+    model.add_cell(newposition, model[model.nearest_index(newposition)].v);
+    
+    global.weights->update(model);
+
+    double moments[2];
+    global.weights->conditional(index, hierarchical.get(0), moments[0], moments[1]);
+    this->reduce(moments, 2);
+
+    if (this->primary()) {
+      if (proposal.prepare(*prior.get_prior(), model.is_logspace(), moments[0], moments[1]) &&
+	  proposal.sample(random, newvalue)) {
+
+	logvalueproposal = proposal.logpdf(newvalue);
+	perturbation = model_delta_t::mkbirth(newposition, newvalue);
+	validproposal = true;
+	
+      } else {
+	perturbation = model_delta_t::mkbirth(newposition, 0.0);
+      }
+    }
+
+    this->communicate(validproposal);
+
+    if (!validproposal) {
+      model.pop();
+      return false;
+    }
+    
+    this->communicate(newvalue);
+    this->communicate(logvalueproposal);
+
+    model[index].v = newvalue;
+    
+    log_prior_ratio =
+      position_prior.logpdf(newposition.phi, newposition.theta) +
+      prior.logpdf(newvalue);
+
+    last_log_proposal_ratio =
+      -global.birthdeathpositionproposal->log_proposal(random,
+						       temperature,
+						       0.0,
+						       0.0,
+						       newposition.phi,
+						       newposition.theta)
+      -logvalueproposal;
+
+    undo_available = true;
+
+    return true;
+  }
+
+  virtual double log_proposal_ratio(Rng &random,
+				    PriorProposal &prior,
+				    SphericalPriorProposal &position_prior,
+				    sphericalvoronoimodel<value> &proposed_model,
+				    PriorProposal &hierarchical_prior,
+				    hierarchical_model &proposed_hierarchical,
+				    double temperature)
+  {
+    return last_log_proposal_ratio;
+  }
+  
+  void accept()
+  {
+    if (!undo_available) {
+      throw ATTENUATIONEXCEPTION("No proposal in progress\n");
+    }
+    
+    a ++;
+    undo_available = false;
+  }
+
+  void reject(sphericalvoronoimodel<value> &model)
+  {
+    if (!undo_available) {
+      throw ATTENUATIONEXCEPTION("No proposal in progress\n");
+    }
+
+    model.pop();
+    
+    undo_available = false;
+  }
+
+  virtual int proposal_count() const
+  {
+    return p;
+  }
+  
+  virtual int acceptance_count() const
+  {
+    return a;
+  }
+
+  virtual const char *displayname() const
+  {
+    return "Birth";
+  }
+
+private:
+
+  globalS2Voronoi<value> &global;
+  ConditionalValueProposal proposal;
+
+  bool undo_available;
+  
+  int p;
+  int a;
+
+  double last_log_proposal_ratio;
+  
+};
+
+#endif // birthconditionalS2Voronoi_hpp
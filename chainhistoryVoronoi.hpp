@@ -27,6 +27,7 @@
 #define chainhistoryVoronoi_hpp
 
 #include <vector>
+#include <string>
 
 #include "coordinate.hpp"
 #include "hierarchical_model.hpp"
@@ -67,6 +68,13 @@ template
 >
 class hierarchical_deltaVoronoi;
 
+template
+<
+  typename coord,
+  typename value
+>
+class adaptation_deltaVoronoi;
+
 template
 <
   typename coord,
@@ -78,7 +86,8 @@ public:
   enum {
     DELTA_INITIALIZATION = 0,
     DELTA_DELTA = 1,
-    DELTA_HIERARCHICAL = 2
+    DELTA_HIERARCHICAL = 2,
+    DELTA_ADAPTATION = 3
   };
 
   deltaVoronoi(int _id) :
@@ -151,6 +160,15 @@ public:
   {
     return accepted;
   }
+
+  //
+  // Whether this record is an iteration of the chain, as opposed to an annotation such as
+  // the adapted proposal widths that is skipped when replaying the chain.
+  //
+  virtual bool isiteration() const
+  {
+    return true;
+  }
   
   virtual double get_proposed_likelihood() const
   {
@@ -175,6 +193,9 @@ public:
     case DELTA_HIERARCHICAL:
       return hierarchical_deltaVoronoi<coord, value>::read(fp);
 
+    case DELTA_ADAPTATION:
+      return adaptation_deltaVoronoi<coord, value>::read(fp);
+
     default:
       fprintf(stderr, "deltaVoronoi::read: invalid unique index: %d (%d)\n", id, (int)readers.size());
       return nullptr;
@@ -491,7 +512,7 @@ public:
 
       case MOVE:
 	{
-	  model[cellindex].c = newposition;
+	  model.move_cell(cellindex, newposition);
 	}
 	break;
 
@@ -772,6 +793,122 @@ private:
   std::vector<hierarchical_term_delta> hierarchical;
 };
 
+//
+// Proposal widths at the end of adaptive tuning during burn in. The widths are fixed from
+// this point in the chain so that subsequent samples are from the posterior.
+//
+template
+<
+  typename coord,
+  typename value
+>
+class adaptation_deltaVoronoi : public deltaVoronoi<coord, value> {
+public:
+
+  adaptation_deltaVoronoi(const std::vector<std::string> &_names,
+			  const std::vector<double> &_scales) :
+    deltaVoronoi<coord, value>(deltaVoronoi<coord, value>::DELTA_ADAPTATION),
+    names(_names),
+    scales(_scales)
+  {
+  }
+  
+  ~adaptation_deltaVoronoi()
+  {
+  }
+  
+  virtual int write(FILE *fp)
+  {
+    if (deltaVoronoi<coord, value>::write_header(fp) < 0) {
+      return -1;
+    }
+    
+    int n = (int)names.size();
+    if (fwrite(&n, sizeof(int), 1, fp) != 1) {
+      return -1;
+    }
+    
+    for (int i = 0; i < n; i ++) {
+      int l = (int)names[i].size();
+      if (fwrite(&l, sizeof(int), 1, fp) != 1) {
+	return -1;
+      }
+      if (fwrite(names[i].c_str(), sizeof(char), l, fp) != (size_t)l) {
+	return -1;
+      }
+      if (fwrite(&(scales[i]), sizeof(double), 1, fp) != 1) {
+	return -1;
+      }
+    }
+    
+    return 0;
+  }
+
+  virtual int apply(sphericalvoronoimodel<value> &model, hierarchical_model &hierarchical)
+  {
+    return 0;
+  }
+
+  virtual bool isiteration() const
+  {
+    return false;
+  }
+
+  const std::vector<std::string> &get_names() const
+  {
+    return names;
+  }
+
+  const std::vector<double> &get_scales() const
+  {
+    return scales;
+  }
+  
+  static deltaVoronoi<coord, value> *read(FILE *fp)
+  {
+    double like;
+    bool accepted;
+    if (deltaVoronoi<coord, value>::read_header(fp, like, accepted) < 0) {
+      return nullptr;
+    }
+    
+    int n;
+    if (fread(&n, sizeof(int), 1, fp) != 1) {
+      return nullptr;
+    }
+
+    std::vector<std::string> names;
+    std::vector<double> scales;
+    
+    for (int i = 0; i < n; i ++) {
+      int l;
+      if (fread(&l, sizeof(int), 1, fp) != 1 || l < 0 || l > 1024) {
+	return nullptr;
+      }
+
+      std::string name(l, ' ');
+      if (fread(&(name[0]), sizeof(char), l, fp) != (size_t)l) {
+	return nullptr;
+      }
+
+      double scale;
+      if (fread(&scale, sizeof(double), 1, fp) != 1) {
+	return nullptr;
+      }
+
+      names.push_back(name);
+      scales.push_back(scale);
+    }
+    
+    return new adaptation_deltaVoronoi(names, scales);
+  }
+  
+private:
+  
+  std::vector<std::string> names;
+  std::vector<double> scales;
+};
+
 template
 <
   typename coord,
@@ -849,6 +986,11 @@ public:
   {
     deltaVoronoi<coord, value> *d = deltaVoronoi<coord, value>::read(fp);
 
+    while (d != nullptr && !d->isiteration()) {
+      delete d;
+      d = deltaVoronoi<coord, value>::read(fp);
+    }
+
     if (d == nullptr) {
       if (feof(fp)) {
 	return 0;
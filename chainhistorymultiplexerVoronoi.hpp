@@ -0,0 +1,145 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#pragma once
+#ifndef chainhistorymultiplexerVoronoi_hpp
+#define chainhistorymultiplexerVoronoi_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chainhistoryVoronoi.hpp"
+
+//
+// Multiplexes the chain history writers of several chains onto a single I/O thread. Chains
+// accumulate steps locally and periodically submit them as a block which the I/O thread
+// writes to the chain's history file in submission order.
+//
+template
+<
+  typename coord,
+  typename value
+>
+class chainhistorymultiplexerVoronoi {
+public:
+
+  typedef chainhistorywriterVoronoi<coord, value> writer_t;
+  typedef deltaVoronoi<coord, value> delta_t;
+
+  chainhistorymultiplexerVoronoi() :
+    shutdown(false),
+    io(&chainhistorymultiplexerVoronoi<coord, value>::run, this)
+  {
+  }
+
+  ~chainhistorymultiplexerVoronoi()
+  {
+    finish();
+  }
+
+  //
+  // Queue a block of steps for a writer. The steps are taken from the vector which is
+  // left empty for reuse by the caller.
+  //
+  void submit(writer_t *writer, std::vector<delta_t*> &steps)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (shutdown) {
+	throw ATTENUATIONEXCEPTION("Submission to finished multiplexer\n");
+      }
+
+      queue.push_back(job_t(writer));
+      queue.back().steps.swap(steps);
+    }
+
+    available.notify_one();
+  }
+
+  //
+  // Write all outstanding blocks and stop the I/O thread
+  //
+  void finish()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shutdown = true;
+    }
+    available.notify_one();
+
+    if (io.joinable()) {
+      io.join();
+    }
+  }
+
+private:
+
+  struct job_t {
+    job_t(writer_t *_writer) :
+      writer(_writer)
+    {
+    }
+
+    writer_t *writer;
+    std::vector<delta_t*> steps;
+  };
+
+  void run()
+  {
+    while (true) {
+
+      job_t job(nullptr);
+
+      {
+	std::unique_lock<std::mutex> lock(mutex);
+	available.wait(lock, [this] { return shutdown || !queue.empty(); });
+
+	if (queue.empty()) {
+	  return;
+	}
+
+	job.writer = queue.front().writer;
+	job.steps.swap(queue.front().steps);
+	queue.pop_front();
+      }
+
+      for (auto &s : job.steps) {
+	job.writer->add(s);
+      }
+      job.writer->flush();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable available;
+  std::deque<job_t> queue;
+  bool shutdown;
+
+  std::thread io;
+};
+
+#endif // chainhistorymultiplexerVoronoi_hpp
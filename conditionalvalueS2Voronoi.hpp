@@ -0,0 +1,203 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef conditionalvalueS2Voronoi_hpp
+#define conditionalvalueS2Voronoi_hpp
+
+#include "conditionalvalueproposal.hpp"
+#include "globalS2Voronoi.hpp"
+#include "perturbationS2Voronoi.hpp"
+
+//
+// Independence Metropolis-Hastings update of a cell value with the proposal drawn from an
+// approximation of the cell's conditional posterior, see ConditionalValueProposal. The
+// acceptance ratio corrects the error of the approximation, which is small as the
+// likelihood dominates, so acceptance is close to but not exactly one.
+//
+template
+<typename value>
+class ConditionalValueS2Voronoi : public PerturbationS2Voronoi<value> {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef typename sphericalvoronoimodel<value>::cell_t cell_t;
+  typedef deltaVoronoi<coord_t, value> delta_t;
+  typedef model_deltaVoronoi<coord_t, value> model_delta_t;
+  
+  ConditionalValueS2Voronoi(globalS2Voronoi<value> &_global) :
+    global(_global),
+    undo_cell(nullptr),
+    undo_v(0.0),
+    last_log_proposal_ratio(0.0),
+    p(0),
+    a(0)
+  {
+    ConditionalValueProposal::check_prior(*global.prior->get_prior(), global.model->is_logspace());
+  }
+  
+  ~ConditionalValueS2Voronoi()
+  {
+  }
+
+  virtual bool propose(int maxcells,
+		       int nobs,
+		       Rng &random,
+		       PriorProposal &prior,
+		       SphericalPriorProposal &position_prior,
+		       sphericalvoronoimodel<value> &model,
+		       PriorProposal &hierarchical_prior,
+		       hierarchical_model &hierarchical,
+		       double temperature,
+		       double &log_prior_ratio,
+		       delta_t *&perturbation)
+  {
+    bool validproposal = false;
+    int cell = -1;
+    value oldv = 0.0;
+    value newv = 0.0;
+
+    if (global.weights == nullptr) {
+      throw ATTENUATIONEXCEPTION("Conditional value update requires the weight operator\n");
+    }
+    
+    if (this->primary()) {
+      p ++;
+      cell = random.uniform(model.ncells());
+    }
+
+    this->communicate(cell);
+
+    //
+    // Every process contributes the moments from its paths
+    //
+    global.weights->update(model);
+
+    double moments[2];
+    global.weights->conditional(cell, hierarchical.get(0), moments[0], moments[1]);
+    this->reduce(moments, 2);
+    
+    if (this->primary()) {
+
+      cell_t *c = model.get_cell_by_index(cell);
+      
+      oldv = todouble<value>(c->v);
+
+      if (proposal.prepare(*prior.get_prior(), model.is_logspace(), moments[0], moments[1]) &&
+	  proposal.sample(random, newv)) {
+
+	log_prior_ratio = prior.logpdf(newv) - prior.logpdf(oldv);
+	last_log_proposal_ratio = proposal.logpdf(oldv) - proposal.logpdf(newv);
+	perturbation = model_delta_t::mkvalue(cell, oldv, newv);
+	
+	validproposal = true;
+	
+      } else {
+	perturbation = model_delta_t::mkvalue(cell, oldv, 0.0);
+      }
+    }
+
+    this->communicate(validproposal);
+
+    if (validproposal) {
+      this->communicate(newv);
+      this->communicate(last_log_proposal_ratio);
+
+      cell_t *c = model.get_cell_by_index(cell);
+      undo_v = c->v;
+      undo_cell = c;
+      
+      fromdouble<value>(newv, c->v);
+    }
+    
+    return validproposal;
+  }
+
+  virtual double log_proposal_ratio(Rng &random,
+				    PriorProposal &prior,
+				    SphericalPriorProposal &position_prior,
+				    sphericalvoronoimodel<value> &proposed_model,
+				    PriorProposal &hierarchical_prior,
+				    hierarchical_model &proposed_hierarchical,
+				    double temperature)
+  {
+    return last_log_proposal_ratio;
+  }
+
+  void accept()
+  {
+    a ++;
+    
+    if (undo_cell == nullptr) {
+      throw ATTENUATIONEXCEPTION("No undo information\n");
+    }
+    
+    undo_cell = nullptr;
+    undo_v = 0.0;
+  }
+  
+  void reject(sphericalvoronoimodel<value> &model)
+  {
+    if (undo_cell == nullptr) {
+      throw ATTENUATIONEXCEPTION("No undo information\n");
+    }
+    
+    undo_cell->v = undo_v;
+    
+    undo_cell = nullptr;
+    undo_v = 0.0;
+  }
+  
+  virtual int proposal_count() const
+  {
+    return p;
+  }
+  
+  virtual int acceptance_count() const
+  {
+    return a;
+  }
+
+  virtual const char *displayname() const
+  {
+    return "CondValue";
+  }
+
+private:
+
+  globalS2Voronoi<value> &global;
+  ConditionalValueProposal proposal;
+  
+  cell_t *undo_cell;
+  value undo_v;
+
+  double last_log_proposal_ratio;
+
+  int p;
+  int a;
+  
+};
+
+#endif // conditionalvalueS2Voronoi_hpp
@@ -0,0 +1,239 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef conditionalvalueproposal_hpp
+#define conditionalvalueproposal_hpp
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "attenuationexception.hpp"
+#include "prior.hpp"
+#include "rng.hpp"
+
+//
+// Independence proposal for the value of a single cell that approximates its conditional
+// posterior. Predictions are linear in s = 1/Q so with the other cells fixed the
+// likelihood of the cell is Gaussian in s with moments from the path weight operator.
+// The proposal is this Gaussian truncated to the prior support, tilted by a second
+// order expansion of the log prior (including the Jacobian of the change to s) about
+// its mean. Only for a prior flat in s is this the exact conditional, for the priors of
+// prior.cpp the moves using it include the Metropolis-Hastings correction. The density is
+// normalised so that it can be used in dimension changing moves. When no path crosses the
+// cell the likelihood is flat and the prior is used.
+//
+class ConditionalValueProposal {
+public:
+
+  //
+  // The support in s must lie within Q > 0, ie a prior on Q (rather than log(Q)) must give
+  // no weight to Q <= 0, eg a LogNormal or a Uniform with a positive lower bound
+  //
+  static void check_prior(Prior &prior, bool logspace)
+  {
+    double vmin, vmax;
+    prior.support(vmin, vmax);
+
+    if (!logspace && (vmin < 0.0 || (vmin == 0.0 && prior.pdf(0.0) > 0.0))) {
+      throw ATTENUATIONEXCEPTION("Conditional value proposal requires a prior on Q with no weight at Q <= 0 (lower bound %g)\n",
+				 vmin);
+    }
+  }
+
+  ConditionalValueProposal() :
+    prior(nullptr),
+    logspace(false),
+    precision(0.0),
+    mean(0.0),
+    slo(0.0),
+    shi(0.0),
+    lognorm(0.0)
+  {
+  }
+
+  //
+  // Set up from the moments of the likelihood in s, ie the precision and precision * mean.
+  // Returns false if the support is empty.
+  //
+  bool prepare(Prior &_prior, bool _logspace, double _precision, double weighted_mean)
+  {
+    prior = &_prior;
+    logspace = _logspace;
+    precision = _precision;
+
+    if (precision <= 0.0) {
+      return true;
+    }
+    
+    double vmin, vmax;
+    prior->support(vmin, vmax);
+
+    if (logspace) {
+      slo = exp(-vmax);
+      shi = exp(-vmin);
+    } else {
+      if (vmin < 0.0) {
+	return false;
+      }
+      slo = 1.0/vmax;
+      shi = (vmin > 0.0) ? 1.0/vmin : HUGE_VAL;
+    }
+
+    mean = weighted_mean/precision;
+
+    //
+    // Tilt by the second order expansion of the log prior in s about the mean (or the
+    // nearest point in the support) when this leaves a positive precision
+    //
+    double s0 = std::min(std::max(mean, slo), shi);
+    double h = 1.0e-4 * s0;
+    if (h > 0.0 && s0 - h > slo && s0 + h < shi) {
+      double gm = log_prior_s(s0 - h);
+      double g0 = log_prior_s(s0);
+      double gp = log_prior_s(s0 + h);
+
+      if (std::isfinite(gm) && std::isfinite(g0) && std::isfinite(gp)) {
+	double d1 = (gp - gm)/(2.0 * h);
+	double d2 = (gp - 2.0 * g0 + gm)/(h * h);
+
+	if (precision - d2 > 0.0) {
+	  mean = s0 + (precision * (mean - s0) + d1)/(precision - d2);
+	  precision -= d2;
+	}
+      }
+    }
+
+    //
+    // Log of the normalising constant of the truncated Gaussian in s
+    //
+    double sigma = 1.0/sqrt(precision);
+    lognorm = log(sigma) + 0.5 * log(2.0 * M_PI) + log_mass((slo - mean)/sigma, (shi - mean)/sigma);
+
+    return std::isfinite(lognorm);
+  }
+
+  //
+  // Returns false if the sample falls outside the prior
+  //
+  bool sample(Rng &random, double &v) const
+  {
+    if (precision <= 0.0) {
+      v = prior->sample(random);
+      return true;
+    }
+    
+    double s = random.truncated_normal(mean, 1.0/sqrt(precision), slo, shi);
+    if (!(s > 0.0)) {
+      return false;
+    }
+
+    v = logspace ? -log(s) : 1.0/s;
+    return std::isfinite(v) && prior->valid(v);
+  }
+
+  //
+  // Normalised log density with respect to the (possibly log) value
+  //
+  double logpdf(double v) const
+  {
+    if (precision <= 0.0) {
+      return prior->logpdf(v);
+    }
+    
+    double s = logspace ? exp(-v) : 1.0/v;
+    if (s < slo || s > shi) {
+      return -HUGE_VAL;
+    }
+    
+    return -0.5 * precision * (s - mean) * (s - mean) - lognorm + log_jacobian(v);
+  }
+  
+private:
+
+  //
+  // Log of |ds/dv|
+  //
+  double log_jacobian(double v) const
+  {
+    if (logspace) {
+      return -v;
+    } else {
+      return -2.0 * log(v);
+    }
+  }
+
+  //
+  // Log prior density with respect to s
+  //
+  double log_prior_s(double s) const
+  {
+    double v = logspace ? -log(s) : 1.0/s;
+
+    return prior->logpdf(v) - log_jacobian(v);
+  }
+
+  //
+  // log(erfc(x)) without underflow for large x
+  //
+  static double log_erfc(double x)
+  {
+    if (x < 25.0) {
+      return log(erfc(x));
+    }
+
+    return -x * x - log(x * sqrt(M_PI)) + log1p(-0.5/(x * x));
+  }
+
+  //
+  // Log of the standard normal mass in (a, b), computed from the tail nearest to the
+  // interval to avoid cancellation
+  //
+  static double log_mass(double a, double b)
+  {
+    if (a > 0.0) {
+      double la = log_erfc(a/M_SQRT2);
+      double lb = log_erfc(b/M_SQRT2);
+      return la + log1p(-exp(lb - la)) - M_LN2;
+    } else if (b < 0.0) {
+      return log_mass(-b, -a);
+    } else {
+      return log1p(-0.5 * erfc(b/M_SQRT2) - 0.5 * erfc(-a/M_SQRT2));
+    }
+  }
+
+  Prior *prior;
+  bool logspace;
+  
+  double precision;
+  double mean;
+  double slo;
+  double shi;
+  double lognorm;
+  
+};
+
+#endif // conditionalvalueproposal_hpp
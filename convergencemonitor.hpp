@@ -0,0 +1,304 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef convergencemonitor_hpp
+#define convergencemonitor_hpp
+
+#include <mpi.h>
+
+#include <math.h>
+
+//
+// Online convergence diagnostics of the likelihood, no. cells and hierarchical lambda of
+// a chain. Samples are accumulated into a fixed number of batches (mean and sum of
+// squared deviations each) and when these are full, adjacent pairs are merged and the
+// batch size doubles, so memory and the cost of an estimate do not grow with the chain.
+// Estimates use the second half of the complete batches so that burn in is discarded as
+// the chain grows. The integrated autocorrelation time is the ratio of the batch means
+// variance to the sample variance, and the effective sample size is n over this. Across
+// chains the effective sample sizes are pooled and the Gelman-Rubin potential scale
+// reduction factor is computed. A series that has not changed over the second half says
+// nothing about mixing, ie the chain may be stuck, and so has an effective sample size
+// of zero.
+//
+class convergencemonitor {
+public:
+
+  typedef enum {
+    LIKELIHOOD = 0,
+    CELLS,
+    LAMBDA,
+    NSERIES
+  } series_t;
+
+  //
+  // Chains with fewer samples in the second half than this are never considered converged
+  //
+  static const int MINIMUM_SAMPLES = 100;
+
+  struct diagnostics_t {
+    int chains;
+    int samples;
+    double ess[NSERIES];
+    double iat[NSERIES];
+    double rhat[NSERIES];
+  };
+
+  //
+  // Lambda is only monitored when it is sampled
+  //
+  convergencemonitor(bool hierarchical) :
+    batchsize(1),
+    nbatches(0),
+    npartial(0)
+  {
+    for (int s = 0; s < NSERIES; s ++) {
+      active[s] = true;
+      partialmean[s] = 0.0;
+      partialm2[s] = 0.0;
+    }
+    active[LAMBDA] = hierarchical;
+  }
+
+  bool is_active(int s) const
+  {
+    return active[s];
+  }
+
+  void add(double likelihood, int k, double lambda)
+  {
+    double y[NSERIES] = {likelihood, (double)k, lambda};
+
+    npartial ++;
+    for (int s = 0; s < NSERIES; s ++) {
+      double delta = y[s] - partialmean[s];
+      partialmean[s] += delta/(double)npartial;
+      partialm2[s] += delta * (y[s] - partialmean[s]);
+    }
+
+    if (npartial == batchsize) {
+      for (int s = 0; s < NSERIES; s ++) {
+	batchmean[s][nbatches] = partialmean[s];
+	batchm2[s][nbatches] = partialm2[s];
+	partialmean[s] = 0.0;
+	partialm2[s] = 0.0;
+      }
+      nbatches ++;
+      npartial = 0;
+
+      if (nbatches == NBATCHES) {
+	//
+	// Merge adjacent pairs of equal sized batches
+	//
+	for (int s = 0; s < NSERIES; s ++) {
+	  for (int j = 0; j < NBATCHES/2; j ++) {
+	    double ma = batchmean[s][2*j];
+	    double mb = batchmean[s][2*j + 1];
+	    batchmean[s][j] = 0.5 * (ma + mb);
+	    batchm2[s][j] = batchm2[s][2*j] + batchm2[s][2*j + 1] +
+	      (mb - ma) * (mb - ma) * 0.5 * (double)batchsize;
+	  }
+	}
+	nbatches = NBATCHES/2;
+	batchsize *= 2;
+      }
+    }
+  }
+
+  //
+  // No. samples used for the estimates, ie those in the second half of the complete batches
+  //
+  int samples() const
+  {
+    return (nbatches - nbatches/2) * batchsize;
+  }
+
+  //
+  // Estimates for one series over the second half of the complete batches
+  //
+  void estimate(int s, double &mean, double &variance, double &iat, double &ess) const
+  {
+    int first = nbatches/2;
+    int a = nbatches - first;
+    int n = a * batchsize;
+
+    mean = 0.0;
+    variance = 0.0;
+    iat = 0.0;
+    ess = 0.0;
+    
+    if (n < 2) {
+      return;
+    }
+
+    for (int j = first; j < nbatches; j ++) {
+      mean += batchmean[s][j];
+    }
+    mean /= (double)a;
+
+    double bss = 0.0;
+    for (int j = first; j < nbatches; j ++) {
+      variance += batchm2[s][j];
+      bss += (batchmean[s][j] - mean) * (batchmean[s][j] - mean);
+    }
+    variance = (variance + (double)batchsize * bss)/(double)(n - 1);
+
+    if (variance <= 0.0 || a < 2) {
+      return;
+    }
+
+    double bvariance = bss * (double)batchsize/(double)(a - 1);
+
+    iat = bvariance/variance;
+    ess = (double)n/iat;
+  }
+
+  //
+  // Combine the diagnostics of the chains on the communicator, local is null for
+  // processes that do not contribute a chain (eg secondaries or heated chains). All
+  // processes on the communicator must call this together and receive the same result.
+  //
+  static void combine(MPI_Comm communicator, const convergencemonitor *local, diagnostics_t &d)
+  {
+    //
+    // Per series: sum of means, sum of squared means, sum of variances, sum of ess and sum
+    // of iat, then the no. chains and the minimum no. samples
+    //
+    const int NSUM = 5;
+    double sums[NSERIES * NSUM + 1];
+    double samples;
+
+    for (int i = 0; i < NSERIES * NSUM + 1; i ++) {
+      sums[i] = 0.0;
+    }
+    samples = HUGE_VAL;
+
+    if (local != nullptr) {
+      for (int s = 0; s < NSERIES; s ++) {
+	double mean, variance, iat, ess;
+	local->estimate(s, mean, variance, iat, ess);
+	if (!local->is_active(s)) {
+	  ess = HUGE_VAL;
+	}
+
+	sums[s * NSUM + 0] = mean;
+	sums[s * NSUM + 1] = mean * mean;
+	sums[s * NSUM + 2] = variance;
+	sums[s * NSUM + 3] = ess;
+	sums[s * NSUM + 4] = iat;
+      }
+      sums[NSERIES * NSUM] = 1.0;
+      samples = local->samples();
+    }
+
+    if (communicator != MPI_COMM_NULL) {
+      double t[NSERIES * NSUM + 1];
+      for (int i = 0; i < NSERIES * NSUM + 1; i ++) {
+	t[i] = sums[i];
+      }
+      MPI_Allreduce(t, sums, NSERIES * NSUM + 1, MPI_DOUBLE, MPI_SUM, communicator);
+
+      double ts = samples;
+      MPI_Allreduce(&ts, &samples, 1, MPI_DOUBLE, MPI_MIN, communicator);
+    }
+
+    int m = (int)sums[NSERIES * NSUM];
+    d.chains = m;
+    d.samples = (m > 0) ? (int)samples : 0;
+
+    for (int s = 0; s < NSERIES; s ++) {
+      d.ess[s] = sums[s * NSUM + 3];
+      d.iat[s] = (m > 0) ? sums[s * NSUM + 4]/(double)m : 0.0;
+      d.rhat[s] = 1.0;
+
+      if (m > 1) {
+	double n = d.samples;
+	double W = sums[s * NSUM + 2]/(double)m;
+	double meanmean = sums[s * NSUM + 0]/(double)m;
+	double Bn = (sums[s * NSUM + 1] - (double)m * meanmean * meanmean)/(double)(m - 1);
+	if (Bn < 0.0) {
+	  Bn = 0.0;
+	}
+
+	if (W > 0.0) {
+	  d.rhat[s] = sqrt(((n - 1.0)/n * W + Bn)/W);
+	} else if (Bn > 0.0) {
+	  d.rhat[s] = HUGE_VAL;
+	}
+      }
+    }
+  }
+
+  //
+  // True once every series has a pooled effective sample size of at least target_ess and,
+  // with more than one chain, a potential scale reduction factor of at most target_rhat
+  //
+  static bool converged(const diagnostics_t &d, double target_ess, double target_rhat)
+  {
+    if (d.chains < 1 || d.samples < MINIMUM_SAMPLES) {
+      return false;
+    }
+
+    for (int s = 0; s < NSERIES; s ++) {
+      if (d.ess[s] < target_ess) {
+	return false;
+      }
+
+      if (d.chains > 1 && d.rhat[s] > target_rhat) {
+	return false;
+      }
+    }
+
+    return true;
+  }
+
+  static const char *name(int s)
+  {
+    static const char *names[NSERIES] = {"Likelihood", "Cells", "Lambda"};
+    return names[s];
+  }
+  
+private:
+
+  //
+  // Must be even so that full batches merge in pairs
+  //
+  static const int NBATCHES = 64;
+
+  bool active[NSERIES];
+
+  int batchsize;
+  int nbatches;
+  double batchmean[NSERIES][NBATCHES];
+  double batchm2[NSERIES][NBATCHES];
+
+  int npartial;
+  double partialmean[NSERIES];
+  double partialm2[NSERIES];
+  
+};
+
+#endif // convergencemonitor_hpp
@@ -0,0 +1,215 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef deathconditionalS2Voronoi_hpp
+#define deathconditionalS2Voronoi_hpp
+
+#include "conditionalvalueproposal.hpp"
+#include "globalS2Voronoi.hpp"
+#include "perturbationS2Voronoi.hpp"
+
+//
+// Reverse of BirthConditionalS2Voronoi. The conditional proposal for the value of the
+// removed cell is that the birth would use to recreate it, ie computed with the cell
+// still present as its own value does not enter the moments.
+//
+template
+<typename value>
+class DeathConditionalS2Voronoi : public PerturbationS2Voronoi<value> {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef deltaVoronoi<coord_t, value> delta_t;
+  typedef model_deltaVoronoi<coord_t, value> model_delta_t;
+  typedef typename sphericalvoronoimodel<value>::cell_t cell_t;
+  
+  DeathConditionalS2Voronoi(globalS2Voronoi<value> &_global) :
+    global(_global),
+    undo_index(-1),
+    p(0),
+    a(0)
+  {
+    ConditionalValueProposal::check_prior(*global.prior->get_prior(), global.model->is_logspace());
+  }
+
+  ~DeathConditionalS2Voronoi()
+  {
+  }
+
+  virtual bool propose(int maxcells,
+		       int nobs,
+		       Rng &random,
+		       PriorProposal &prior,
+		       SphericalPriorProposal &position_prior,
+		       sphericalvoronoimodel<value> &model,
+		       PriorProposal &hierarchical_prior,
+		       hierarchical_model &hierarchical,
+		       double temperature,
+		       double &log_prior_ratio,
+		       delta_t *&perturbation)
+  {
+    bool validproposal = false;
+    int cell;
+    double logvalueproposal = 0.0;
+
+    if (global.weights == nullptr) {
+      throw ATTENUATIONEXCEPTION("Conditional death requires the weight operator\n");
+    }
+    
+    if (this->primary()) {
+      
+      p ++;
+    
+      int k = model.ncells();
+      if (k > 1) {
+	
+	cell = random.uniform(k);
+	validproposal = true;
+	perturbation = model_delta_t::mkdeath(cell);
+
+      } else {
+	perturbation = model_delta_t::mkdeath(-1);
+      }
+    }
+
+    this->communicate(validproposal);
+
+    if (validproposal) {
+
+      this->communicate(cell);
+
+      //
+      // Store undo information
+      //
+      cell_t *c = model.get_cell_by_index(cell);
+
+      undo_index = cell;
+      undo_coord = c->c;
+      undo_value = c->v;
+
+      global.weights->update(model);
+
+      double moments[2];
+      global.weights->conditional(cell, hierarchical.get(0), moments[0], moments[1]);
+      this->reduce(moments, 2);
+
+      if (this->primary()) {
+	if (proposal.prepare(*prior.get_prior(), model.is_logspace(), moments[0], moments[1])) {
+	  logvalueproposal = proposal.logpdf(undo_value);
+	} else {
+	  logvalueproposal = -HUGE_VAL;
+	}
+      }
+      this->communicate(logvalueproposal);
+      
+      //
+      // Compute ratios
+      //
+      log_prior_ratio = -(prior.logpdf(undo_value) + position_prior.logpdf(undo_coord.phi,
+									   undo_coord.theta));
+      model.delete_cell(cell);
+      
+      last_log_proposal_ratio =
+	global.birthdeathpositionproposal->log_proposal(random,
+							temperature,
+							0.0,
+							0.0,
+							undo_coord.phi,
+							undo_coord.theta) +
+	logvalueproposal;
+    }
+
+    return validproposal;
+  }
+
+  virtual double log_proposal_ratio(Rng &random,
+				    PriorProposal &prior,
+				    SphericalPriorProposal &position_prior,
+				    sphericalvoronoimodel<value> &proposed_model,
+				    PriorProposal &hierarchical_prior,
+				    hierarchical_model &proposed_hierarchical,
+				    double temperature)
+  {
+    return last_log_proposal_ratio;
+  }
+  
+  void accept()
+  {
+    a ++;
+    
+    if (undo_index < 0) {
+      throw ATTENUATIONEXCEPTION("No undo information\n");
+    }
+    
+    undo_index = -1;
+  }
+
+  void reject(sphericalvoronoimodel<value> &model)
+  {
+    if (undo_index < 0) {
+      throw ATTENUATIONEXCEPTION("No undo information\n");
+    }
+
+    //
+    // Re-insert the deleted node
+    //
+    model.insert_cell(undo_index, undo_coord, undo_value);
+
+    undo_index = -1;
+  }
+
+  virtual int proposal_count() const
+  {
+    return p;
+  }
+  
+  virtual int acceptance_count() const
+  {
+    return a;
+  }
+
+  virtual const char *displayname() const
+  {
+    return "Death";
+  }
+
+private:
+
+  globalS2Voronoi<value> &global;
+  ConditionalValueProposal proposal;
+  
+  int undo_index;
+  value undo_value;
+  coord_t undo_coord;
+
+  double last_log_proposal_ratio;
+
+  int p;
+  int a;
+
+};
+
+#endif // deathconditionalS2Voronoi_hpp
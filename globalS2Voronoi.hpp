@@ -31,10 +31,12 @@
 #include "sphericalvoronoimodel.hpp"
 
 #include "attenuationdataS2.hpp"
+#include "pathweightsS2Voronoi.hpp"
 #include "prior.hpp"
 #include "sphericalprior.hpp"
 
 #include "hierarchical_model.hpp"
+#include "instrumentation.hpp"
 
 extern "C" {
   #include "slog.h"
@@ -66,6 +68,7 @@ public:
     mpi_offsets(nullptr),
     data(nullptr),
     model(nullptr),
+    weights(nullptr),
     prior(nullptr),
     positionprior(nullptr),
     hierarchicalprior(nullptr),
@@ -78,8 +81,12 @@ public:
     mean_residuals(nullptr),
     residuals(nullptr),
     last_valid_residuals(nullptr),
+    last_valid_weight(0),
+    early_rejection_checks(8),
+    surrogate_stride(4),
     maxcells(_maxcells),
-    random(seed)
+    random(seed),
+    owner(true)
   {
 
     if (prior_file == nullptr) {
@@ -147,6 +154,7 @@ public:
       mean_residuals = new value[residual_size];
       last_valid_residuals = new value[residual_size];
       mean_residual_n = 0;
+      last_valid_weight = 0;
       for (int i = 0; i < residual_size; i ++) {
 	residuals[i] = 0.0;
 	mean_residuals[i] = 0.0;
@@ -177,6 +185,100 @@ public:
       INFO("Loaded model with %d cells", model->ncells());
 
     }
+
+    model->enable_triangulation();
+  }
+
+  //
+  // Replica that shares the data, priors and proposals of another instance but has its
+  // own model, hierarchical parameters, residuals and random stream. Used for per thread
+  // evaluation of proposals.
+  //
+  globalS2Voronoi(const globalS2Voronoi<value> &shared, int seed) :
+    communicator(MPI_COMM_NULL),
+    rank(-1),
+    size(-1),
+    mpi_counts(nullptr),
+    mpi_offsets(nullptr),
+    data(shared.data),
+    model(new sphericalvoronoimodel<value>(*shared.model)),
+    weights(nullptr),
+    prior(shared.prior),
+    positionprior(shared.positionprior),
+    hierarchicalprior(shared.hierarchicalprior),
+    birthdeathvalueproposal(shared.birthdeathvalueproposal),
+    birthdeathpositionproposal(shared.birthdeathpositionproposal),
+    hierarchical(new singlescaling_hierarchical_model()),
+    temperature(shared.temperature),
+    residual_size(shared.residual_size),
+    mean_residual_n(0),
+    mean_residuals(nullptr),
+    residuals(nullptr),
+    last_valid_residuals(nullptr),
+    last_valid_weight(0),
+    early_rejection_checks(shared.early_rejection_checks),
+    surrogate_stride(shared.surrogate_stride),
+    maxcells(shared.maxcells),
+    random(seed),
+    owner(false)
+  {
+    if (data) {
+      residuals = new value[residual_size];
+      mean_residuals = new value[residual_size];
+      last_valid_residuals = new value[residual_size];
+      for (int i = 0; i < residual_size; i ++) {
+	residuals[i] = 0.0;
+	mean_residuals[i] = 0.0;
+	last_valid_residuals[i] = 0.0;
+      }
+    }
+
+    synchronise(shared);
+  }
+
+  //
+  // A replica frees only its own state, the data, priors and proposals belong to the
+  // instance it was made from
+  //
+  ~globalS2Voronoi()
+  {
+    delete model;
+    delete weights;
+    delete hierarchical;
+
+    delete [] mpi_counts;
+    delete [] mpi_offsets;
+    delete [] mean_residuals;
+    delete [] residuals;
+    delete [] last_valid_residuals;
+
+    if (owner) {
+      delete birthdeathvalueproposal;
+      delete birthdeathpositionproposal;
+      delete prior;
+      delete positionprior;
+      delete hierarchicalprior;
+      delete data;
+    }
+  }
+
+  globalS2Voronoi(const globalS2Voronoi<value> &) = delete;
+  globalS2Voronoi &operator=(const globalS2Voronoi<value> &) = delete;
+
+  //
+  // Copy the model and hierarchical parameters from another instance
+  //
+  void synchronise(const globalS2Voronoi<value> &source)
+  {
+    *model = *source.model;
+    if (weights != nullptr) {
+      model->enable_journal();
+    } else {
+      model->disable_journal();
+    }
+    for (int i = 0; i < source.hierarchical->get_nhierarchical(); i ++) {
+      hierarchical->set(i, source.hierarchical->get(i));
+    }
   }
 
   void initialize_mpi(MPI_Comm _communicator, double _temperature)
@@ -210,8 +312,55 @@ public:
     }
   }
 
+  //
+  // Maintain the sparse path/cell weight operator for the paths of this process so that the
+  // likelihood is updated in proportion to the paths affected by a change to the model
+  // rather than recomputed from every path. Must follow initialize_mpi and any reordering
+  // of the paths.
+  //
+  void enable_weight_operator()
+  {
+    if (data == nullptr) {
+      return;
+    }
+    
+    delete weights;
+    if (communicator == MPI_COMM_NULL) {
+      weights = new pathweightsS2Voronoi<value>(*data, 0, residual_size);
+    } else {
+      weights = new pathweightsS2Voronoi<value>(*data, mpi_offsets[rank], mpi_counts[rank]);
+    }
+
+    model->enable_journal();
+  }
+
   value likelihood()
   {
+    if (data && weights != nullptr) {
+      weights->update(*model);
+      
+      if (communicator == MPI_COMM_NULL) {
+	return weights->likelihood(hierarchical->get(0), residuals);
+      } else {
+	value plike = weights->likelihood(hierarchical->get(0), residuals + mpi_offsets[rank]);
+	value sumlike;
+	INSTRUMENT_START(COLLECTIVE);
+	MPI_Allreduce(&plike, &sumlike, 1, MPI_DOUBLE, MPI_SUM, communicator);
+
+	MPI_Allgatherv(residuals + mpi_offsets[rank],
+		       mpi_counts[rank],
+		       MPI_DOUBLE,
+		       residuals,
+		       mpi_counts,
+		       mpi_offsets,
+		       MPI_DOUBLE,
+		       communicator);
+	INSTRUMENT_END(COLLECTIVE);
+
+	return sumlike;
+      }
+    }
+    
     if (data) {
       if (communicator == MPI_COMM_NULL) {
 	return data->likelihood(*model, hierarchical->get(0), residuals);
@@ -223,6 +372,7 @@ public:
 					       mpi_counts[rank],
 					       residuals + mpi_offsets[rank]);
 	value sumlike;
+	INSTRUMENT_START(COLLECTIVE);
 	MPI_Reduce(&plike, &sumlike, 1, MPI_DOUBLE, MPI_SUM, 0, communicator);
 	MPI_Bcast(&sumlike, 1, MPI_DOUBLE, 0, communicator);
 
@@ -234,6 +384,7 @@ public:
 		       mpi_offsets,
 		       MPI_DOUBLE,
 		       communicator);
+	INSTRUMENT_END(COLLECTIVE);
 
 	return sumlike;
 	
@@ -243,29 +394,256 @@ public:
     }
   }
 
-  void accept()
+  //
+  // Likelihood evaluation that stops as soon as the negative log likelihood is known to
+  // exceed the threshold, ie when the proposal is certain to be rejected. With multiple
+  // processes, the partial sums are combined after each of early_rejection_checks blocks
+  // so that all processes abandon the evaluation together. When complete is false, the
+  // returned value is a lower bound and the residuals are invalid. The weight operator
+  // updates are already cheaper than an early exit so with it the evaluation is always
+  // complete.
+  //
+  value likelihood(value threshold, bool &complete)
   {
-    for (int i = 0; i < residual_size; i ++) {
-      last_valid_residuals[i] = residuals[i];
+    if (data && weights != nullptr) {
+      complete = true;
+      return likelihood();
+    }
+    
+    if (data) {
+      if (communicator == MPI_COMM_NULL) {
+	return data->likelihood_partial(*model,
+					hierarchical->get(0),
+					0,
+					residual_size,
+					residuals,
+					threshold,
+					complete);
+      } else {
+
+	int offset = mpi_offsets[rank];
+	int count = mpi_counts[rank];
+
+	value plike = 0.0;
+	value sumlike = 0.0;
+	bool local_complete = true;
+
+	complete = true;
+	for (int b = 0; b < early_rejection_checks; b ++) {
+
+	  int boffset = offset + (count * b)/early_rejection_checks;
+	  int bcount = offset + (count * (b + 1))/early_rejection_checks - boffset;
+
+	  if (local_complete && bcount > 0) {
+	    bool bcomplete;
+	    plike += data->likelihood_partial(*model,
+					      hierarchical->get(0),
+					      boffset,
+					      bcount,
+					      residuals + boffset,
+					      threshold - plike,
+					      bcomplete);
+	    local_complete = bcomplete;
+	  }
+
+	  value t = plike;
+	  INSTRUMENT_START(COLLECTIVE);
+	  MPI_Allreduce(&t, &sumlike, 1, MPI_DOUBLE, MPI_SUM, communicator);
+	  INSTRUMENT_END(COLLECTIVE);
+
+	  if (sumlike > threshold) {
+	    complete = false;
+	    return sumlike;
+	  }
+	}
+
+	INSTRUMENT_START(COLLECTIVE);
+	MPI_Allgatherv(residuals + offset,
+		       count,
+		       MPI_DOUBLE,
+		       residuals,
+		       mpi_counts,
+		       mpi_offsets,
+		       MPI_DOUBLE,
+		       communicator);
+	INSTRUMENT_END(COLLECTIVE);
+
+	return sumlike;
+	
+      }
+    } else {
+      complete = true;
+      return 1.0;
+    }
+  }
+
+  //
+  // Likelihoods of several instances sharing the same data computed in a single pass over
+  // the data, equivalent to calling likelihood() on each. Only for serial instances.
+  //
+  static void likelihood_batch(int n, globalS2Voronoi<value> * const *instances, value *likelihoods)
+  {
+    if (n <= 0) {
+      return;
+    }
+    
+    attenuationdataS2<value> *data = instances[0]->data;
+    if (data == nullptr) {
+      for (int i = 0; i < n; i ++) {
+	likelihoods[i] = 1.0;
+      }
+      return;
+    }
+    
+    std::vector<const sphericalvoronoimodel<value>*> models(n);
+    std::vector<double> lambdas(n);
+    std::vector<value*> residuals(n);
+
+    for (int i = 0; i < n; i ++) {
+      if (instances[i]->data != data || instances[i]->communicator != MPI_COMM_NULL) {
+	throw ATTENUATIONEXCEPTION("Batch likelihood requires serial instances with shared data\n");
+      }
+
+      models[i] = instances[i]->model;
+      lambdas[i] = instances[i]->hierarchical->get(0);
+      residuals[i] = instances[i]->residuals;
+    }
+
+    data->likelihood_batch(n,
+			   models.data(),
+			   lambdas.data(),
+			   0,
+			   instances[0]->residual_size,
+			   residuals.data(),
+			   likelihoods);
+  }
+
+  //
+  // Surrogate likelihood for delayed acceptance computed from every surrogate_stride'th
+  // path. The residuals buffer is partially overwritten so a full likelihood evaluation
+  // must follow before an accept.
+  //
+  value surrogate_likelihood()
+  {
+    if (data) {
+      if (communicator == MPI_COMM_NULL) {
+	return data->likelihood_decimated(*model,
+					  hierarchical->get(0),
+					  0,
+					  residual_size,
+					  surrogate_stride,
+					  residuals);
+      } else {
+
+	value plike = data->likelihood_decimated(*model,
+						 hierarchical->get(0),
+						 mpi_offsets[rank],
+						 mpi_counts[rank],
+						 surrogate_stride,
+						 residuals + mpi_offsets[rank]);
+	value sumlike;
+	INSTRUMENT_START(COLLECTIVE);
+	MPI_Allreduce(&plike, &sumlike, 1, MPI_DOUBLE, MPI_SUM, communicator);
+	INSTRUMENT_END(COLLECTIVE);
+
+	return sumlike;
+      }
+    } else {
+      return 1.0;
     }
+  }
+
+  void accept()
+  {
+    //
+    // The outgoing residuals are folded into the mean weighted by the number of
+    // iterations they remained current, then the buffers are swapped so that the
+    // proposed residuals become the last valid ones.
+    //
     update_mean_residual();
+
+    value *t = last_valid_residuals;
+    last_valid_residuals = residuals;
+    residuals = t;
+
+    last_valid_weight = 1;
   }
 
   void reject()
   {
-    update_mean_residual();
+    last_valid_weight ++;
   }
 
   void update_mean_residual()
   {
-    mean_residual_n ++;
+    if (last_valid_weight > 0) {
+      mean_residual_n += last_valid_weight;
+
+      double w = (double)last_valid_weight/(double)mean_residual_n;
+      for (int i = 0; i < residual_size; i ++) {
+	value delta = last_valid_residuals[i] - mean_residuals[i];
+	mean_residuals[i] += delta * w;
+      }
+
+      last_valid_weight = 0;
+    }
+  }
+
+  //
+  // Returns the mean residuals including the weight of the current residuals, in the order
+  // of the observations file
+  //
+  const value *get_mean_residuals()
+  {
+    update_mean_residual();
+
+    if (data == nullptr) {
+      return mean_residuals;
+    }
+
+    ordered_residuals.resize(residual_size);
+    data->restore_order(mean_residuals, ordered_residuals.data());
+    return ordered_residuals.data();
+  }
+
+  //
+  // When the birth/death position proposal is a residual mixture, set its masses from the
+  // squared normalised residuals of the current model with each path's misfit spread over
+  // its points in proportion to their length. Must be called after accept so that the
+  // current residuals are the last valid ones.
+  //
+  void update_birth_proposal()
+  {
+    ResidualMixtureSphericalProposal *mixture =
+      dynamic_cast<ResidualMixtureSphericalProposal*>(birthdeathpositionproposal);
+
+    if (mixture == nullptr || data == nullptr) {
+      return;
+    }
+
+    mixture->clear();
 
     for (int i = 0; i < residual_size; i ++) {
-      value delta = last_valid_residuals[i] - mean_residuals[i];
-      mean_residuals[i] += delta/(double)mean_residual_n;
+      auto &path = data->data[i];
+
+      double length = 0.0;
+      for (auto &p : path.points) {
+	length += p.distance;
+      }
+
+      if (length > 0.0) {
+	double r = last_valid_residuals[i]/path.noise;
+	double misfit = r * r/length;
+
+	for (auto &p : path.points) {
+	  mixture->add(p.phi, p.theta, misfit * p.distance);
+	}
+      }
     }
+
+    mixture->build();
   }
-  
+
 
   MPI_Comm communicator;
   int rank;
@@ -275,6 +653,7 @@ public:
 
   attenuationdataS2<value> *data;
   sphericalvoronoimodel<value> *model;
+  pathweightsS2Voronoi<value> *weights;
 
   PriorProposal *prior;
   SphericalPriorProposal *positionprior;
@@ -291,10 +670,19 @@ public:
   value *mean_residuals;
   value *residuals;
   value *last_valid_residuals;
+  int last_valid_weight;
+  std::vector<value> ordered_residuals;
+
+  int early_rejection_checks;
+  int surrogate_stride;
 
   int maxcells;
   
   Rng random;
+
+private:
+
+  bool owner;
   
 };
 
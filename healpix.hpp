@@ -0,0 +1,237 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef healpix_hpp
+#define healpix_hpp
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+//
+// Equal area HEALPix pixelisation of the sphere in RING ordering (Gorski et al. 2005). The
+// sphere is divided into 12 nside^2 pixels of equal area on 4 nside - 1 rings of constant
+// colatitude with the pixels equally spaced in longitude on each ring. Compared with a
+// regular longitude/latitude grid of the same equatorial resolution it needs roughly a
+// third of the pixels as the poles are not oversampled.
+//
+// Colatitude phi is 0 (north pole) .. pi, longitude theta is 0 .. 2 pi.
+//
+class healpix {
+public:
+
+  healpix(int _nside) :
+    nside(_nside),
+    npix(12 * _nside * _nside),
+    ncap(2 * _nside * (_nside - 1))
+  {
+  }
+
+  int get_nside() const
+  {
+    return nside;
+  }
+
+  int npixels() const
+  {
+    return npix;
+  }
+
+  int nrings() const
+  {
+    return 4 * nside - 1;
+  }
+
+  //
+  // Ring r in 1 .. nrings, its colatitude, longitude of its first pixel, no. pixels and
+  // index of its first pixel.
+  //
+  void ring(int r, double &phi, double &theta0, int &n, int &first) const
+  {
+    if (r < nside) {
+      n = 4 * r;
+      first = 2 * r * (r - 1);
+      phi = acos(1.0 - (double)(r * r)/(3.0 * nside * nside));
+      theta0 = M_PI/(4.0 * r);
+    } else if (r <= 3 * nside) {
+      n = 4 * nside;
+      first = ncap + (r - nside) * 4 * nside;
+      phi = acos((double)(2 * nside - r) * 2.0/(3.0 * nside));
+      theta0 = ((r - nside) & 1) ? 0.0 : M_PI/(4.0 * nside);
+    } else {
+      int s = 4 * nside - r;
+      n = 4 * s;
+      first = npix - 2 * s * (s + 1);
+      phi = acos(-1.0 + (double)(s * s)/(3.0 * nside * nside));
+      theta0 = M_PI/(4.0 * s);
+    }
+  }
+
+  //
+  // Centre of pixel p
+  //
+  void pix2ang(int p, double &phi, double &theta) const
+  {
+    int r;
+    if (p < ncap) {
+      r = (1 + (int)sqrt(1.0 + 2.0 * p))/2;
+      if (2 * r * (r - 1) > p) {
+	r --;
+      } else if (2 * (r + 1) * r <= p) {
+	r ++;
+      }
+    } else if (p < npix - ncap) {
+      r = (p - ncap)/(4 * nside) + nside;
+    } else {
+      int s = (1 + (int)sqrt(2.0 * (npix - p) - 1.0))/2;
+      if (npix - 2 * s * (s + 1) > p) {
+	s ++;
+      } else if (npix - 2 * s * (s - 1) <= p) {
+	s --;
+      }
+      r = 4 * nside - s;
+    }
+
+    double theta0;
+    int n, first;
+    ring(r, phi, theta0, n, first);
+    theta = theta0 + (double)(p - first) * 2.0 * M_PI/(double)n;
+  }
+
+  //
+  // Pixel containing a point
+  //
+  int ang2pix(double phi, double theta) const
+  {
+    double z = cos(phi);
+    double za = fabs(z);
+    double tt = fmod(theta, 2.0 * M_PI);
+    if (tt < 0.0) {
+      tt += 2.0 * M_PI;
+    }
+    tt /= M_PI/2.0; // 0 .. 4
+
+    if (za <= 2.0/3.0) {
+      double temp1 = nside * (0.5 + tt);
+      double temp2 = nside * z * 0.75;
+      int jp = (int)(temp1 - temp2);
+      int jm = (int)(temp1 + temp2);
+      int ir = nside + 1 + jp - jm;
+      int kshift = 1 - (ir & 1);
+      int ip = (jp + jm - nside + kshift + 1)/2;
+      ip = ip % (4 * nside);
+
+      return ncap + (ir - 1) * 4 * nside + ip;
+    } else {
+      double tp = tt - (int)tt;
+      double tmp = nside * sqrt(3.0 * (1.0 - za));
+      int jp = (int)(tp * tmp);
+      int jm = (int)((1.0 - tp) * tmp);
+      int ir = jp + jm + 1;
+      int ip = (int)(tt * ir);
+      ip = ip % (4 * ir);
+
+      if (z > 0.0) {
+	return 2 * ir * (ir - 1) + ip;
+      } else {
+	return npix - 2 * ir * (ir + 1) + ip;
+      }
+    }
+  }
+
+  //
+  // Binary map file: 4 byte magic "HPXR", 32 bit nside, then the 12 nside^2 pixel values
+  // as 32 bit floats in ring order (native byte order).
+  //
+  bool save(const char *filename, const double *map) const
+  {
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+      return false;
+    }
+
+    int32_t n = nside;
+    bool ok = fwrite(magic_string(), 1, 4, fp) == 4 && fwrite(&n, sizeof(n), 1, fp) == 1;
+
+    for (int i = 0; i < npix && ok; i ++) {
+      float v = (float)map[i];
+      ok = fwrite(&v, sizeof(v), 1, fp) == 1;
+    }
+
+    fclose(fp);
+    return ok;
+  }
+
+  //
+  // Load a map, returns the nside (or -1 on error) and allocates the map
+  //
+  static int load(const char *filename, double *&map)
+  {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) {
+      return -1;
+    }
+
+    char magic[4];
+    int32_t n;
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, magic_string(), 4) != 0 ||
+	fread(&n, sizeof(n), 1, fp) != 1 || n < 1) {
+      fclose(fp);
+      return -1;
+    }
+
+    int size = 12 * n * n;
+    map = new double[size];
+    
+    for (int i = 0; i < size; i ++) {
+      float v;
+      if (fread(&v, sizeof(v), 1, fp) != 1) {
+	fclose(fp);
+	delete [] map;
+	map = nullptr;
+	return -1;
+      }
+      map[i] = v;
+    }
+
+    fclose(fp);
+    return n;
+  }
+
+private:
+
+  static const char *magic_string()
+  {
+    return "HPXR";
+  }
+
+  int nside;
+  int npix;
+  int ncap;
+};
+
+#endif // healpix_hpp
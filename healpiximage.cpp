@@ -0,0 +1,174 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <getopt.h>
+
+#include "healpix.hpp"
+
+//
+// Reprojects a binary HEALPix map onto the regular longitude/latitude text image used by
+// the other post-processing tools for plotting.
+//
+
+static char short_options[] = "i:o:W:H:h";
+
+static struct option long_options[] = {
+  {"input", required_argument, 0, 'i'},
+  {"output", required_argument, 0, 'o'},
+  {"lonsamples", required_argument, 0, 'W'},
+  {"latsamples", required_argument, 0, 'H'},
+  {"help", no_argument, 0, 'h'},
+  {0, 0, 0, 0}
+};
+
+static void usage(const char *pname);
+
+int main(int argc, char *argv[])
+{
+  int c;
+  int option_index;
+
+  char *input;
+  char *output;
+  
+  int lonsamples;
+  int latsamples;
+
+  //
+  // Defaults
+  //
+  input = nullptr;
+  output = nullptr;
+  
+  lonsamples = 360;
+  latsamples = 180;
+
+  option_index = 0;
+  while (1) {
+
+    c = getopt_long(argc, argv, short_options, long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+
+    switch (c) {
+
+    case 'i':
+      input = optarg;
+      break;
+
+    case 'o':
+      output = optarg;
+      break;
+
+    case 'W':
+      lonsamples = atoi(optarg);
+      if (lonsamples < 1) {
+	fprintf(stderr, "error: lonsamples must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'H':
+      latsamples = atoi(optarg);
+      if (latsamples < 1) {
+	fprintf(stderr, "error: latsamples must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'h':
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (input == nullptr) {
+    fprintf(stderr, "error: required input file parameter missing\n");
+    return -1;
+  }
+
+  if (output == nullptr) {
+    fprintf(stderr, "error: required output file parameter missing\n");
+    return -1;
+  }
+
+  double *map;
+  int nside = healpix::load(input, map);
+  if (nside < 0) {
+    fprintf(stderr, "error: failed to load HEALPix map %s\n", input);
+    return -1;
+  }
+
+  healpix grid(nside);
+
+  FILE *fp = fopen(output, "w");
+  if (fp == NULL) {
+    fprintf(stderr, "error: failed to create output file\n");
+    return -1;
+  }
+
+  for (int j = 0; j < latsamples; j ++) {
+
+    // North Pole to South Pole
+    double imagephi = ((double)j + 0.5)/(double)latsamples * M_PI;
+    
+    for (int i = 0; i < lonsamples; i ++) {
+
+      // -180 .. 180
+      double imagetheta = ((double)i + 0.5)/(double)lonsamples * 2.0 * M_PI - M_PI;
+
+      fprintf(fp, "%10.6f ", map[grid.ang2pix(imagephi, imagetheta)]);
+    }
+    fprintf(fp, "\n");
+  }
+
+  fclose(fp);
+  delete [] map;
+  
+  return 0;
+}
+
+static void usage(const char *pname)
+{
+  fprintf(stderr,
+	  "usage: %s [options]\n"
+	  "where options is one or more of:\n"
+	  "\n"
+	  " -i|--input <filename>       Input HEALPix map (required)\n"
+	  " -o|--output <filename>      Output longitude/latitude image (required)\n"
+	  "\n"
+	  " -W|--lonsamples <int>       No. samples in longitude direction (default 360)\n"
+	  " -H|--latsamples <int>       No. samples in latitude direction (default 180)\n"
+	  "\n"
+	  " -h|--help                   Usage\n"
+	  "\n",
+	  pname);
+}
@@ -162,6 +162,21 @@ public:
     return a;
   }
 
+  virtual double get_scale(PriorProposal &prior,
+			   SphericalPriorProposal &position_prior,
+			   PriorProposal &hierarchical_prior)
+  {
+    return hierarchical_prior.get_proposal()->get_scale();
+  }
+
+  virtual void set_scale(PriorProposal &prior,
+			 SphericalPriorProposal &position_prior,
+			 PriorProposal &hierarchical_prior,
+			 double scale)
+  {
+    hierarchical_prior.get_proposal()->set_scale(scale);
+  }
+
   virtual const char *displayname() const
   {
     return "Hierarchical";
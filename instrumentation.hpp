@@ -0,0 +1,411 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#pragma once
+#ifndef instrumentation_hpp
+#define instrumentation_hpp
+
+//
+// Timing of the phases of each iteration per perturbation type, enabled by compiling with
+// -DINSTRUMENTATION (see the Makefile), otherwise the macros below compile to nothing. The
+// current category (the perturbation type) is set by the perturbation collections when a
+// proposal is made and the phases that follow are attributed to it. Phases may nest, eg
+// the collectives are also counted within the likelihood. Timers are per thread and may be
+// merged into process wide totals when a thread finishes.
+//
+// Optionally each timed span is also recorded (up to a fixed number per process) with the
+// clocks of all processes aligned to that of rank 0 and written at the end as a single
+// Chrome trace event file (for chrome://tracing or Perfetto) showing compute and
+// communication on every rank.
+//
+#ifdef INSTRUMENTATION
+
+#include <mpi.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "tracking.h"
+};
+
+class instrumentation {
+public:
+
+  enum {
+    PROPOSE,
+    LIKELIHOOD,
+    COLLECTIVE,
+    ACCEPT,
+    HISTORY,
+    NPHASES
+  };
+
+  static instrumentation &local()
+  {
+    static thread_local instrumentation i;
+    return i;
+  }
+
+  //
+  // Totals of the threads that have called merge
+  //
+  static instrumentation &combined()
+  {
+    static instrumentation i;
+    return i;
+  }
+
+  //
+  // Add the timers of this thread to the combined totals
+  //
+  static void merge()
+  {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    instrumentation &l = local();
+    instrumentation &c = combined();
+    for (int i = 0; i < (int)l.names.size(); i ++) {
+      c.category(l.names[i]);
+      for (int j = 0; j < NPHASES; j ++) {
+	tracking_merge(&c.timers[c.current * NPHASES + j], &l.timers[i * NPHASES + j]);
+      }
+    }
+  }
+
+  void category(const char *name)
+  {
+    if (names[current] == name) {
+      return;
+    }
+    
+    for (int i = 0; i < (int)names.size(); i ++) {
+      if (names[i] == name || strcmp(names[i], name) == 0) {
+	current = i;
+	return;
+      }
+    }
+
+    names.push_back(name);
+    timers.resize(timers.size() + NPHASES);
+    for (int i = 0; i < NPHASES; i ++) {
+      tracking_init(&timers[timers.size() - NPHASES + i]);
+    }
+    current = names.size() - 1;
+  }
+
+  void start(int phase)
+  {
+    tracking_start(&timers[current * NPHASES + phase]);
+  }
+
+  void end(int phase)
+  {
+    tracking_t *t = &timers[current * NPHASES + phase];
+    tracking_end(t);
+
+    if (trace_capacity > 0) {
+      if ((int)spans.size() < trace_capacity) {
+	span s;
+	s.start = microseconds(t->start);
+	s.end = microseconds(t->end);
+	s.category = current;
+	s.phase = phase;
+	spans.push_back(s);
+      } else {
+	trace_dropped ++;
+      }
+    }
+  }
+
+  //
+  // Record up to capacity spans, collective over the communicator so that the clocks can be
+  // aligned. Each process estimates the offset of its clock from that of rank 0 from the
+  // round trip with the smallest delay of ALIGNMENT_ROUNDS exchanges (as in NTP) and the
+  // trace time origin is rank 0's clock here.
+  //
+  void trace(MPI_Comm communicator, int capacity)
+  {
+    int rank;
+    int size;
+
+    MPI_Comm_rank(communicator, &rank);
+    MPI_Comm_size(communicator, &size);
+
+    trace_capacity = capacity;
+    trace_dropped = 0;
+    spans.clear();
+    spans.reserve(capacity);
+
+    clock_offset = 0.0;
+    for (int r = 1; r < size; r ++) {
+      if (rank == 0) {
+	double best_delay = -1.0;
+	double best_offset = 0.0;
+	
+	for (int i = 0; i < ALIGNMENT_ROUNDS; i ++) {
+	  double remote;
+	  double sent = now();
+	  MPI_Send(&sent, 1, MPI_DOUBLE, r, ALIGNMENT_TAG, communicator);
+	  MPI_Recv(&remote, 1, MPI_DOUBLE, r, ALIGNMENT_TAG, communicator, MPI_STATUS_IGNORE);
+	  double received = now();
+
+	  double delay = received - sent;
+	  if (best_delay < 0.0 || delay < best_delay) {
+	    best_delay = delay;
+	    best_offset = remote - 0.5 * (sent + received);
+	  }
+	}
+
+	MPI_Send(&best_offset, 1, MPI_DOUBLE, r, ALIGNMENT_TAG, communicator);
+	
+      } else if (rank == r) {
+	for (int i = 0; i < ALIGNMENT_ROUNDS; i ++) {
+	  double sent;
+	  MPI_Recv(&sent, 1, MPI_DOUBLE, 0, ALIGNMENT_TAG, communicator, MPI_STATUS_IGNORE);
+	  double local = now();
+	  MPI_Send(&local, 1, MPI_DOUBLE, 0, ALIGNMENT_TAG, communicator);
+	}
+
+	MPI_Recv(&clock_offset, 1, MPI_DOUBLE, 0, ALIGNMENT_TAG, communicator, MPI_STATUS_IGNORE);
+      }
+    }
+
+    trace_origin = now();
+    MPI_Bcast(&trace_origin, 1, MPI_DOUBLE, 0, communicator);
+  }
+
+  //
+  // Gather the spans of all processes to rank 0 which writes the trace file, one process
+  // per rank, collective over the communicator given to trace.
+  //
+  bool write_trace(MPI_Comm communicator, const char *filename)
+  {
+    int rank;
+    int size;
+    char buffer[1024];
+    std::string events;
+
+    MPI_Comm_rank(communicator, &rank);
+    MPI_Comm_size(communicator, &size);
+
+    sprintf(buffer,
+	    "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": 0, "
+	    "\"args\": {\"name\": \"Rank %d\"}},\n",
+	    rank, rank);
+    events += buffer;
+
+    if (trace_dropped > 0) {
+      sprintf(buffer,
+	      "{\"name\": \"dropped %d spans\", \"ph\": \"i\", \"s\": \"p\", \"pid\": %d, \"tid\": 0, "
+	      "\"ts\": %.3f},\n",
+	      trace_dropped, rank, spans.empty() ? 0.0 : spans.back().end - clock_offset - trace_origin);
+      events += buffer;
+    }
+    
+    for (auto &s : spans) {
+      sprintf(buffer,
+	      "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": 0, "
+	      "\"ts\": %.3f, \"dur\": %.3f},\n",
+	      phasename(s.phase),
+	      names[s.category],
+	      rank,
+	      s.start - clock_offset - trace_origin,
+	      s.end - s.start);
+      events += buffer;
+    }
+
+    int length = events.size();
+    std::vector<int> lengths(size);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, communicator);
+
+    std::vector<int> offsets(size, 0);
+    std::vector<char> all;
+    if (rank == 0) {
+      for (int i = 1; i < size; i ++) {
+	offsets[i] = offsets[i - 1] + lengths[i - 1];
+      }
+      all.resize(offsets[size - 1] + lengths[size - 1]);
+    }
+
+    MPI_Gatherv(&events[0], length, MPI_CHAR,
+		all.data(), lengths.data(), offsets.data(), MPI_CHAR,
+		0, communicator);
+
+    bool r = true;
+    if (rank == 0) {
+      FILE *fp = fopen(filename, "w");
+      if (fp == NULL) {
+	r = false;
+      } else {
+	//
+	// Strip the trailing separator for valid JSON
+	//
+	size_t n = all.size();
+	while (n > 0 && (all[n - 1] == '\n' || all[n - 1] == ',')) {
+	  n --;
+	}
+
+	fprintf(fp, "[\n");
+	fwrite(all.data(), 1, n, fp);
+	fprintf(fp, "\n]\n");
+	fclose(fp);
+      }
+    }
+
+    return r;
+  }
+
+  bool write(const char *filename)
+  {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+      return false;
+    }
+
+    fprintf(fp, "# %-12s %-10s %9s %12s %12s %12s %12s %12s %14s\n",
+	    "category", "phase", "samples", "mean", "p50", "p90", "p99", "max", "total");
+    fprintf(fp, "# times in microseconds\n");
+    
+    for (int i = 0; i < (int)names.size(); i ++) {
+      for (int j = 0; j < NPHASES; j ++) {
+	tracking_t *t = &timers[i * NPHASES + j];
+	if (tracking_samples(t) == 0) {
+	  continue;
+	}
+
+	fprintf(fp, "  %-12s %-10s %9d %12.3f %12.3f %12.3f %12.3f %12.3f %14.1f\n",
+		names[i],
+		phasename(j),
+		tracking_samples(t),
+		tracking_mean(t),
+		tracking_percentile(t, 0.5),
+		tracking_percentile(t, 0.9),
+		tracking_percentile(t, 0.99),
+		tracking_maximum(t),
+		tracking_total(t));
+      }
+    }
+
+    fclose(fp);
+    return true;
+  }
+
+  static const char *phasename(int phase)
+  {
+    static const char *NAMES[NPHASES] = {
+      "propose",
+      "likelihood",
+      "collective",
+      "accept",
+      "history"
+    };
+
+    return NAMES[phase];
+  }
+  
+private:
+
+  //
+  // Anything timed before the first proposal, eg the initial likelihood, is under Other
+  //
+  instrumentation() :
+    current(0),
+    trace_capacity(0),
+    trace_dropped(0),
+    clock_offset(0.0),
+    trace_origin(0.0)
+  {
+    names.push_back("Other");
+    timers.resize(NPHASES);
+    for (auto &t : timers) {
+      tracking_init(&t);
+    }
+  }
+
+  static const int ALIGNMENT_ROUNDS = 16;
+  static const int ALIGNMENT_TAG = 8317;
+
+  struct span {
+    double start;
+    double end;
+    int category;
+    int phase;
+  };
+
+  static double microseconds(const struct timespec &t)
+  {
+    return (double)t.tv_sec * 1.0e6 + (double)t.tv_nsec * 1.0e-3;
+  }
+
+  static double now()
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return microseconds(t);
+  }
+
+  std::vector<const char *> names;
+  std::vector<tracking_t> timers;
+  int current;
+
+  int trace_capacity;
+  int trace_dropped;
+  std::vector<span> spans;
+  double clock_offset;
+  double trace_origin;
+  
+};
+
+#define INSTRUMENT_CATEGORY(name) instrumentation::local().category(name)
+#define INSTRUMENT_START(phase) instrumentation::local().start(instrumentation::phase)
+#define INSTRUMENT_END(phase) instrumentation::local().end(instrumentation::phase)
+#define INSTRUMENT_WRITE(filename) instrumentation::local().write(filename)
+#define INSTRUMENT_MERGE() instrumentation::merge()
+#define INSTRUMENT_WRITE_COMBINED(filename) instrumentation::combined().write(filename)
+#define INSTRUMENT_TRACE(communicator, capacity) instrumentation::local().trace(communicator, capacity)
+#define INSTRUMENT_WRITE_TRACE(communicator, filename) instrumentation::local().write_trace(communicator, filename)
+#define INSTRUMENT_ENABLED true
+
+#else // INSTRUMENTATION
+
+#define INSTRUMENT_CATEGORY(name) do {} while (0)
+#define INSTRUMENT_START(phase) do {} while (0)
+#define INSTRUMENT_END(phase) do {} while (0)
+#define INSTRUMENT_WRITE(filename) do {} while (0)
+#define INSTRUMENT_MERGE() do {} while (0)
+#define INSTRUMENT_WRITE_COMBINED(filename) do {} while (0)
+#define INSTRUMENT_TRACE(communicator, capacity) do {} while (0)
+#define INSTRUMENT_WRITE_TRACE(communicator, filename) do {} while (0)
+#define INSTRUMENT_ENABLED false
+
+#endif // INSTRUMENTATION
+
+#endif // instrumentation_hpp
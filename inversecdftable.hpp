@@ -0,0 +1,221 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef inversecdftable_hpp
+#define inversecdftable_hpp
+
+#include <vector>
+
+#include <math.h>
+
+#include "attenuationexception.hpp"
+
+//
+// Sampling from a one dimensional density by inversion of its CDF. The inverse CDF is
+// tabulated once at equally spaced probabilities with its derivative 1/pdf and each draw is
+// a cubic Hermite interpolation within the bracket [x_k, x_k+1] containing it. When the
+// table is built the interpolation is checked at CHECKS points within every bracket and
+// those where it is not within CHECK_MARGIN * TOLERANCE of the CDF (ie where the pdf
+// vanishes or varies quickly, typically at the ends of the support) are instead polished
+// with safeguarded Newton steps from the interpolated value, falling back to bisection
+// within the bracket. Polished draws have |cdf(x) - u| < TOLERANCE (or the bracket has
+// narrowed below TOLERANCE). For interpolated draws this is only checked at the sample
+// points, with the margin allowing for the error between them, and is not a bound.
+//
+class inversecdftable {
+public:
+
+  typedef double (*function_f)(void *user, double x);
+
+  static constexpr double TOLERANCE = 1.0e-9;
+  static const int DEFAULT_SIZE = 1024;
+  static const int MAXIMUM_STEPS = 64;
+
+  inversecdftable() :
+    cdf(nullptr),
+    pdf(nullptr),
+    user(nullptr)
+  {
+  }
+
+  //
+  // The cdf must be monotonic on [xmin, xmax] with cdf(xmin) = 0 and cdf(xmax) = 1 and pdf
+  // its derivative.
+  //
+  void build(function_f _cdf,
+	     function_f _pdf,
+	     void *_user,
+	     double xmin,
+	     double xmax,
+	     int size = DEFAULT_SIZE)
+  {
+    if (size < 1 || !(xmax > xmin)) {
+      throw ATTENUATIONEXCEPTION("Invalid table size %d or range %f .. %f\n", size, xmin, xmax);
+    }
+
+    cdf = _cdf;
+    pdf = _pdf;
+    user = _user;
+
+    x.resize(size + 1);
+    slope.resize(size + 1);
+    polish.resize(size);
+    
+    x[0] = xmin;
+    x[size] = xmax;
+
+    //
+    // Each node by bisection from the previous as the nodes are increasing
+    //
+    for (int k = 1; k < size; k ++) {
+      double u = (double)k/(double)size;
+      double lo = x[k - 1];
+      double hi = xmax;
+
+      while (hi - lo > 1.0e-15 * (xmax - xmin)) {
+	double mid = 0.5 * (lo + hi);
+	if (mid <= lo || mid >= hi) {
+	  break;
+	}
+	
+	if (cdf(user, mid) < u) {
+	  lo = mid;
+	} else {
+	  hi = mid;
+	}
+      }
+
+      x[k] = 0.5 * (lo + hi);
+    }
+
+    //
+    // Derivative of the inverse CDF with respect to the position within a bracket
+    //
+    for (int k = 0; k <= size; k ++) {
+      double g = pdf(user, x[k]);
+      if (g > 0.0) {
+	slope[k] = 1.0/(g * (double)size);
+      } else {
+	slope[k] = -1.0;
+      }
+    }
+
+    for (int k = 0; k < size; k ++) {
+      polish[k] = (slope[k] < 0.0) || (slope[k + 1] < 0.0);
+
+      for (int i = 1; i < CHECKS && !polish[k]; i ++) {
+	double t = (double)i/(double)CHECKS;
+	double u = ((double)k + t)/(double)size;
+	
+	polish[k] = fabs(cdf(user, interpolate(k, t)) - u) >= CHECK_MARGIN * TOLERANCE;
+      }
+    }
+  }
+
+  bool is_built() const
+  {
+    return cdf != nullptr;
+  }
+
+  double sample(double u) const
+  {
+    int size = (int)x.size() - 1;
+    
+    double t = u * (double)size;
+    int k = (int)t;
+    if (k < 0) {
+      k = 0;
+      t = 0.0;
+    } else if (k >= size) {
+      k = size - 1;
+      t = (double)size;
+    }
+
+    t -= (double)k;
+    if (!polish[k]) {
+      return interpolate(k, t);
+    }
+
+    double lo = x[k];
+    double hi = x[k + 1];
+    double xs = lo + t * (hi - lo);
+
+    for (int i = 0; i < MAXIMUM_STEPS && (hi - lo) > TOLERANCE; i ++) {
+
+      double r = cdf(user, xs) - u;
+      if (fabs(r) < TOLERANCE) {
+	break;
+      }
+
+      if (r > 0.0) {
+	hi = xs;
+      } else {
+	lo = xs;
+      }
+
+      double g = pdf(user, xs);
+      double xn = 0.5 * (lo + hi);
+      if (g > 0.0) {
+	double xnewton = xs - r/g;
+	if (xnewton > lo && xnewton < hi) {
+	  xn = xnewton;
+	}
+      }
+
+      xs = xn;
+    }
+
+    return xs;
+  }
+
+private:
+
+  static const int CHECKS = 32;
+  static constexpr double CHECK_MARGIN = 0.1;
+
+  double interpolate(int k, double t) const
+  {
+    double t2 = t * t;
+    double t3 = t2 * t;
+
+    return
+      (2.0 * t3 - 3.0 * t2 + 1.0) * x[k] +
+      (t3 - 2.0 * t2 + t) * slope[k] +
+      (-2.0 * t3 + 3.0 * t2) * x[k + 1] +
+      (t3 - t2) * slope[k + 1];
+  }
+  
+  function_f cdf;
+  function_f pdf;
+  void *user;
+
+  std::vector<double> x;
+  std::vector<double> slope;
+  std::vector<bool> polish;
+  
+};
+
+#endif // inversecdftable_hpp
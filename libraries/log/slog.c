@@ -3,16 +3,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <errno.h>
 #include <limits.h>
 
 #include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "slog.h"
 
-static char *log_file = NULL;
+/*
+ * Size of the stdio buffer of the log file and the number of messages that may be queued
+ * for the background thread (a power of 2).
+ */
+#define SLOG_BUFFER_SIZE 65536
+#define SLOG_QUEUE_SIZE 1024
 
-static char *timestamp(void);
+static FILE *log_fp = NULL;
+
+static int message_emit(int level, char *buffer, size_t length);
+static char *timestamp(char *buffer, size_t size);
 
 static const char *LEVEL_MESSAGE[] = {
   "error",
@@ -21,48 +33,217 @@ static const char *LEVEL_MESSAGE[] = {
   "debug",
   ""
 };
-  
-int slog_set_output_file(const char *filename,
-			 int flags)
+
+/*
+ * Bounded multiple producer, single consumer queue of formatted messages (Vyukov's bounded
+ * queue). Each cell's sequence number says whether it is free for the producer claiming
+ * position pos (sequence == pos) or holds a message for the consumer (sequence == pos + 1).
+ */
+typedef struct {
+  atomic_size_t sequence;
+  char *buffer;
+  size_t length;
+} slog_cell_t;
+
+static slog_cell_t queue[SLOG_QUEUE_SIZE];
+static atomic_size_t enqueue_position;
+static atomic_size_t dequeue_position;
+
+static atomic_size_t enqueued;
+static atomic_size_t written;
+
+static int async = 0;
+static atomic_int stopping;
+static pthread_t writer_thread;
+
+static int registered = 0;
+
+static int queue_push(char *buffer, size_t length)
 {
-  FILE *fp;
+  slog_cell_t *cell;
+  size_t pos = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+
+  for (;;) {
+    size_t seq;
+    intptr_t dif;
+
+    cell = &queue[pos & (SLOG_QUEUE_SIZE - 1)];
+    seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    dif = (intptr_t)seq - (intptr_t)pos;
+
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&enqueue_position, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed)) {
+	break;
+      }
+    } else if (dif < 0) {
+      /* Full */
+      return -1;
+    } else {
+      pos = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+    }
+  }
+
+  cell->buffer = buffer;
+  cell->length = length;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+  return 0;
+}
+
+static int queue_pop(char **buffer, size_t *length)
+{
+  slog_cell_t *cell;
+  size_t pos = atomic_load_explicit(&dequeue_position, memory_order_relaxed);
+  size_t seq;
+
+  cell = &queue[pos & (SLOG_QUEUE_SIZE - 1)];
+  seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+  if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) {
+    /* Empty */
+    return -1;
+  }
+
+  /* Single consumer so the position can simply be advanced */
+  atomic_store_explicit(&dequeue_position, pos + 1, memory_order_relaxed);
+
+  *buffer = cell->buffer;
+  *length = cell->length;
+  atomic_store_explicit(&cell->sequence, pos + SLOG_QUEUE_SIZE, memory_order_release);
+
+  return 0;
+}
 
-  if (log_file != NULL) {
-    free(log_file);
+static void *writer_main(void *arg)
+{
+  char *buffer;
+  size_t length;
+  int idle = 0;
+  struct timespec pause;
+
+  pause.tv_sec = 0;
+  pause.tv_nsec = 1000000;
+
+  for (;;) {
+    if (queue_pop(&buffer, &length) == 0) {
+      fwrite(buffer, 1, length, log_fp);
+      free(buffer);
+      atomic_fetch_add(&written, 1);
+      idle = 0;
+    } else if (atomic_load(&stopping)) {
+      break;
+    } else {
+      /* Push out what has been written once the queue goes quiet */
+      if (!idle) {
+	fflush(log_fp);
+	idle = 1;
+      }
+      nanosleep(&pause, NULL);
+    }
   }
 
-  log_file = malloc(sizeof(char) * PATH_MAX);
-  if (log_file == NULL) {
-    fprintf(stderr, "slog_set_output_file: failed to allocate log file buffer\n");
+  fflush(log_fp);
+  return NULL;
+}
+
+static int start_writer(void)
+{
+  int i;
+
+  for (i = 0; i < SLOG_QUEUE_SIZE; i ++) {
+    atomic_init(&queue[i].sequence, i);
+    queue[i].buffer = NULL;
+    queue[i].length = 0;
+  }
+  atomic_init(&enqueue_position, 0);
+  atomic_init(&dequeue_position, 0);
+  atomic_init(&enqueued, 0);
+  atomic_init(&written, 0);
+  atomic_init(&stopping, 0);
+
+  if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+    fprintf(stderr, "slog: failed to start log writer thread\n");
     return -1;
   }
 
-  if (flags && SLOG_FLAGS_CLEAR) {
+  async = 1;
+  return 0;
+}
+
+int slog_set_output_file(const char *filename,
+			 int flags)
+{
+  FILE *fp;
+  char stamp[64];
+
+  slog_close();
+
+  if (flags & SLOG_FLAGS_CLEAR) {
     fp = fopen(filename, "w");
   } else {
     fp = fopen(filename, "a");
   }
 
   if (fp == NULL) {
-    free(log_file);
-    log_file = NULL;
     fprintf(stderr, "log: failed to create/open log file\n");
     return -1;
   }
-  
-  fprintf(fp, "%s: begin\n", timestamp());
-  fclose(fp);
-
-  if (realpath(filename, log_file) == NULL) {
-    fprintf(stderr, "slog_set_output_file: failed to get absolution file name\n");
-    free(log_file);
-    log_file = NULL;
-    return -1;
+
+  if (setvbuf(fp, NULL, _IOFBF, SLOG_BUFFER_SIZE) != 0) {
+    fprintf(stderr, "slog_set_output_file: failed to set log file buffer\n");
+  }
+
+  fprintf(fp, "%s: begin\n", timestamp(stamp, sizeof(stamp)));
+  fflush(fp);
+
+  log_fp = fp;
+
+  if (!registered) {
+    atexit(slog_close);
+    registered = 1;
+  }
+
+  if (flags & SLOG_FLAGS_ASYNC) {
+    if (start_writer() < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int slog_flush(void)
+{
+  if (log_fp == NULL) {
+    return 0;
+  }
+
+  if (async) {
+    while (atomic_load(&written) != atomic_load(&enqueued)) {
+      sched_yield();
+    }
   }
-  
+
+  fflush(log_fp);
   return 0;
 }
 
+void slog_close(void)
+{
+  if (log_fp == NULL) {
+    return;
+  }
+
+  if (async) {
+    atomic_store(&stopping, 1);
+    pthread_join(writer_thread, NULL);
+    async = 0;
+  }
+
+  fclose(log_fp);
+  log_fp = NULL;
+}
+
 int slog(int level,
 	 const char *source_file,
 	 const char *function,
@@ -72,7 +253,7 @@ int slog(int level,
 {
   va_list ap;
   int r;
-  
+
   va_start(ap, msg);
   r = vslog(level, source_file, function, lineno, msg, ap);
   va_end(ap);
@@ -87,56 +268,100 @@ int vslog(int level,
 	  const char *msg,
 	  va_list ap)
 {
-  FILE *fp;
-  
-  if (log_file != NULL) {
-    fp = fopen(log_file, "a");
-    if (fp == NULL) {
-      fprintf(stderr, "slog: failed to open log file in append mode %s, %s\n", log_file, strerror(errno));
-      return -1;
+  char stamp[64];
+  char header[1024];
+  char *buffer;
+  int header_length;
+  int message_length;
+  va_list aq;
+
+  header_length = snprintf(header, sizeof(header), "%s:%s:%s:%s:%4d:",
+			   timestamp(stamp, sizeof(stamp)),
+			   LEVEL_MESSAGE[level],
+			   source_file,
+			   function,
+			   lineno);
+  if (header_length < 0) {
+    return -1;
+  }
+  if (header_length >= (int)sizeof(header)) {
+    header_length = sizeof(header) - 1;
+  }
+
+  va_copy(aq, ap);
+  message_length = vsnprintf(NULL, 0, msg, aq);
+  va_end(aq);
+  if (message_length < 0) {
+    return -1;
+  }
+
+  buffer = malloc(header_length + message_length + 2);
+  if (buffer == NULL) {
+    fprintf(stderr, "slog: failed to allocate message buffer\n");
+    return -1;
+  }
+
+  memcpy(buffer, header, header_length);
+  vsnprintf(buffer + header_length, message_length + 1, msg, ap);
+  buffer[header_length + message_length] = '\n';
+  buffer[header_length + message_length + 1] = '\0';
+
+  return message_emit(level, buffer, header_length + message_length + 1);
+}
+
+/*
+ * Write (or queue) a complete message and take ownership of its buffer
+ */
+static int message_emit(int level, char *buffer, size_t length)
+{
+  if (log_fp == NULL) {
+    fwrite(buffer, 1, length, stderr);
+    free(buffer);
+    return 0;
+  }
+
+  if (async) {
+    atomic_fetch_add(&enqueued, 1);
+    while (queue_push(buffer, length) < 0) {
+      sched_yield();
     }
   } else {
-    fp = stderr;
+    fwrite(buffer, 1, length, log_fp);
+    free(buffer);
   }
 
-  fprintf(fp, "%s:%s:%s:%s:%4d:",
-	  timestamp(),
-	  LEVEL_MESSAGE[level],
-	  source_file,
-	  function,
-	  lineno);
-
-  vfprintf(fp, msg, ap);
-  fprintf(fp, "\n");
-  
-  if (log_file != NULL) {
-    fclose(fp);
+  if (level == SLOG_ERROR) {
+    slog_flush();
   }
 
   return 0;
 }
 
-static FILE *slogopen = NULL;
+/*
+ * Multi-part messages are assembled in memory and emitted as one message when complete.
+ * The partial messages are per thread so that threads may build messages concurrently.
+ */
+static _Thread_local FILE *slogopen = NULL;
+static _Thread_local char *slogopen_buffer = NULL;
+static _Thread_local size_t slogopen_length = 0;
 
 FILE *slogstart(const char *source_file,
 		 const char *function,
 		 int lineno)
 {
+  char stamp[64];
+
   if (slogopen == NULL) {
-    if (log_file != NULL) {
-      slogopen = fopen(log_file, "a");
-      if (slogopen == NULL) {
-	fprintf(stderr, "slog: failed to open log file in append mode %s, %s\n", log_file, strerror(errno));
-	return NULL;
-      }
-    } else {
-      slogopen = stderr;
+    slogopen = open_memstream(&slogopen_buffer, &slogopen_length);
+    if (slogopen == NULL) {
+      fprintf(stderr, "slog: failed to open message buffer, %s\n", strerror(errno));
+      return NULL;
     }
   }
 
   fprintf(slogopen,
 	  "%s:%s:%s:%s:%4d:\n",
-	  timestamp(),
+	  timestamp(stamp, sizeof(stamp)),
 	  "LONG",
 	  source_file,
 	  function,
@@ -150,18 +375,22 @@ void slogend()
   if (slogopen != NULL) {
 
     fprintf(slogopen, "\n");
-    
-    if (slogopen != stderr) {
-      fclose(slogopen);
-    }
+    fclose(slogopen);
     slogopen = NULL;
+
+    message_emit(SLOG_INFO, slogopen_buffer, slogopen_length);
+    slogopen_buffer = NULL;
+    slogopen_length = 0;
   }
 }
-  
-		   
 
 
-static FILE *large_message_fp = NULL;
+
+
+static _Thread_local FILE *large_message_fp = NULL;
+static _Thread_local char *large_message_buffer = NULL;
+static _Thread_local size_t large_message_length = 0;
+static _Thread_local int large_message_level = SLOG_INFO;
 
 int slog_large_message_start(int level,
 			     const char *source_file,
@@ -171,19 +400,17 @@ int slog_large_message_start(int level,
 			     ...)
 {
   va_list ap;
-    
-  if (log_file != NULL) {
-    large_message_fp = fopen(log_file, "a");
-    if (large_message_fp == NULL) {
-      fprintf(stderr, "log: failed to open log file in append mode\n");
-      return -1;
-    }
-  } else {
-    large_message_fp = stderr;
+  char stamp[64];
+
+  large_message_fp = open_memstream(&large_message_buffer, &large_message_length);
+  if (large_message_fp == NULL) {
+    fprintf(stderr, "log: failed to open message buffer\n");
+    return -1;
   }
+  large_message_level = level;
 
   fprintf(large_message_fp, "%s:%s:%s:%s:%4d:",
-	  timestamp(),
+	  timestamp(stamp, sizeof(stamp)),
 	  LEVEL_MESSAGE[level],
 	  source_file,
 	  function,
@@ -201,12 +428,12 @@ int slog_large_message_start(int level,
 int slog_large_message_write(const char *msg, ...)
 {
   va_list ap;
-  
+
   if (large_message_fp == NULL) {
     fprintf(stderr, "slog_large_message_write: unassigned output\n");
     return -1;
   }
-  
+
   va_start(ap, msg);
   vfprintf(large_message_fp, msg, ap);
   va_end(ap);
@@ -227,33 +454,36 @@ int slog_large_message_newline(void)
 
 int slog_large_message_end(void)
 {
+  int r;
+
   if (large_message_fp == NULL) {
     fprintf(stderr, "slog_large_message_write: unassigned output\n");
     return -1;
   }
 
   fprintf(large_message_fp, "\n");
-
-  if (large_message_fp != stderr) {
-    fclose(large_message_fp);
-  }
+  fclose(large_message_fp);
   large_message_fp = NULL;
-  return 0;
+
+  r = message_emit(large_message_level, large_message_buffer, large_message_length);
+  large_message_buffer = NULL;
+  large_message_length = 0;
+
+  return r;
 }
 
-static char *timestamp(void)
+static char *timestamp(char *buffer, size_t size)
 {
   const char *TIME_FORMAT = "%Y-%m-%d %H:%M:%S";
-  static char buffer[256];
   time_t tmp;
-  struct tm *t;
+  struct tm t;
 
   tmp = time(NULL);
-  t = localtime(&tmp);
-  
-  if (strftime(buffer, sizeof(buffer), TIME_FORMAT, t) == 0) {
+  localtime_r(&tmp, &t);
+
+  if (strftime(buffer, size, TIME_FORMAT, &t) == 0) {
     fprintf(stderr, "log::timestamp: failed to format time\n");
-    return NULL;
+    buffer[0] = '\0';
   }
 
   return buffer;
@@ -6,7 +6,8 @@
 
 enum {
   SLOG_FLAGS_NONE = 0,
-  SLOG_FLAGS_CLEAR = 1
+  SLOG_FLAGS_CLEAR = 1,
+  SLOG_FLAGS_ASYNC = 2
 };
 
 enum {
@@ -16,16 +17,39 @@ enum {
   SLOG_DEBUG
 };
 
+/*
+ * Messages above this level are removed at compile time (their arguments are not evaluated),
+ * eg compile with -DSLOG_LEVEL=SLOG_WARNING to remove INFO and DEBUG messages.
+ */
+#ifndef SLOG_LEVEL
+#define SLOG_LEVEL SLOG_DEBUG
+#endif
+
 /*
  * By default, logs go to stderr, this redirects to a file which is optionally overwritten.
+ * The file is kept open and buffered, errors are flushed immediately and the remainder at
+ * exit or on slog_flush. With SLOG_FLAGS_ASYNC, messages are formatted by the caller then
+ * queued without locking for a background thread to write. Use a separate file per process
+ * when running in parallel.
  */
 int slog_set_output_file(const char *filename,
 			 int flags);
 
-#define ERROR(fmt, ...) slog(SLOG_ERROR, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define WARNING(fmt, ...) slog(SLOG_WARNING, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define INFO(fmt, ...) slog(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define DEBUG(fmt, ...) slog(SLOG_WARNING, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
+/*
+ * Wait for queued messages to be written and flush the file.
+ */
+int slog_flush(void);
+
+/*
+ * Flush, stop the background thread (if any) and close the file, subsequent messages go to
+ * stderr. Called automatically at exit.
+ */
+void slog_close(void);
+
+#define ERROR(fmt, ...) ((SLOG_ERROR <= SLOG_LEVEL) ? slog(SLOG_ERROR, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define WARNING(fmt, ...) ((SLOG_WARNING <= SLOG_LEVEL) ? slog(SLOG_WARNING, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define INFO(fmt, ...) ((SLOG_INFO <= SLOG_LEVEL) ? slog(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define DEBUG(fmt, ...) ((SLOG_DEBUG <= SLOG_LEVEL) ? slog(SLOG_DEBUG, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
 
 int slog(int level,
 	 const char *source_file,
@@ -41,10 +65,10 @@ int vslog(int level,
 	  const char *msg,
 	  va_list ap);
 
-#define INFO_LARGE_START(fmt, ...) slog_large_message_start(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__)
-#define INFO_LARGE_WRITE(fmt, ...) slog_large_message_write(fmt, ##__VA_ARGS__)
-#define INFO_LARGE_NEWLINE() slog_large_message_newline()
-#define INFO_LARGE_END() slog_large_message_end()
+#define INFO_LARGE_START(fmt, ...) ((SLOG_INFO <= SLOG_LEVEL) ? slog_large_message_start(SLOG_INFO, __FILE__, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__) : 0)
+#define INFO_LARGE_WRITE(fmt, ...) ((SLOG_INFO <= SLOG_LEVEL) ? slog_large_message_write(fmt, ##__VA_ARGS__) : 0)
+#define INFO_LARGE_NEWLINE() ((SLOG_INFO <= SLOG_LEVEL) ? slog_large_message_newline() : 0)
+#define INFO_LARGE_END() ((SLOG_INFO <= SLOG_LEVEL) ? slog_large_message_end() : 0)
 
 int slog_large_message_start(int level,
 			     const char *source_file,
@@ -69,3 +93,4 @@ void slogend();
 
 
 #endif /* log_h */
+
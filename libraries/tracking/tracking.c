@@ -1,15 +1,27 @@
 
 #include <stdio.h>
+#include <math.h>
 
 #include <time.h>
 
 #include "tracking.h"
 
+static int bucket(double usec);
+static double bucket_lower(int b);
+
 void tracking_init(tracking_t *t)
 {
+  int i;
+  
   t->n = 0;
   t->mean = 0.0;
+  t->total = 0.0;
+  t->maximum = 0.0;
   t->started = 0;
+
+  for (i = 0; i < TRACKING_BUCKETS; i ++) {
+    t->histogram[i] = 0;
+  }
 };
 
 int tracking_start(tracking_t *t)
@@ -20,7 +32,7 @@ int tracking_start(tracking_t *t)
   }
 
   t->started = 1;
-  clock_gettime(CLOCK_REALTIME, &t->start);
+  clock_gettime(CLOCK_MONOTONIC, &t->start);
 
   return 0;
 }
@@ -30,14 +42,13 @@ int tracking_end(tracking_t *t)
   long nsec;
   time_t dsec;
   double msec;
-  double delta;
 
   if (t->started == 0) {
     fprintf(stderr, "Tracking not started\n");
     return -1;
   }
 
-  clock_gettime(CLOCK_REALTIME, &t->end);
+  clock_gettime(CLOCK_MONOTONIC, &t->end);
 
   dsec = t->end.tv_sec - t->start.tv_sec;
   nsec = t->end.tv_nsec - t->start.tv_nsec;
@@ -45,14 +56,48 @@ int tracking_end(tracking_t *t)
   msec = 
     (double)dsec * 1000000.0 + 
     (double)nsec / 1000.0;
+
+  tracking_add(t, msec);
     
-  delta = msec - t->mean;
+  t->started = 0;
+
+  return 0;
+}
+
+void tracking_add(tracking_t *t, double usec)
+{
+  double delta;
+  
+  delta = usec - t->mean;
   t->n ++;
   t->mean += delta/(double)(t->n);
 
-  t->started = 0;
+  t->total += usec;
+  if (usec > t->maximum) {
+    t->maximum = usec;
+  }
 
-  return 0;
+  t->histogram[bucket(usec)] ++;
+}
+
+void tracking_merge(tracking_t *t, const tracking_t *src)
+{
+  int i;
+
+  if (src->n == 0) {
+    return;
+  }
+  
+  t->n += src->n;
+  t->total += src->total;
+  t->mean = t->total/(double)t->n;
+  if (src->maximum > t->maximum) {
+    t->maximum = src->maximum;
+  }
+
+  for (i = 0; i < TRACKING_BUCKETS; i ++) {
+    t->histogram[i] += src->histogram[i];
+  }
 }
 
 void tracking_print(tracking_t *t, const char *label)
@@ -70,3 +115,71 @@ double tracking_mean(tracking_t *t)
   return t->mean;
 }
 
+double tracking_total(tracking_t *t)
+{
+  return t->total;
+}
+
+double tracking_maximum(tracking_t *t)
+{
+  return t->maximum;
+}
+
+double tracking_percentile(tracking_t *t, double p)
+{
+  int i;
+  double target;
+  double cumulative;
+  double v;
+
+  if (t->n == 0) {
+    return 0.0;
+  }
+
+  target = p * (double)t->n;
+  cumulative = 0.0;
+  for (i = 0; i < TRACKING_BUCKETS - 1; i ++) {
+    cumulative += (double)t->histogram[i];
+    if (cumulative >= target) {
+      break;
+    }
+  }
+
+  /* Geometric centre of the bucket, which cannot exceed the largest sample */
+  v = sqrt(bucket_lower(i) * bucket_lower(i + 1));
+  if (v > t->maximum) {
+    v = t->maximum;
+  }
+  
+  return v;
+}
+
+/*
+ * Bucket 0 holds durations under 1ns, bucket b > 0 those from bucket_lower(b)
+ */
+static int bucket(double usec)
+{
+  double nsec = usec * 1000.0;
+  int b;
+
+  if (!(nsec >= 1.0)) {
+    return 0;
+  }
+
+  b = 1 + (int)(log2(nsec) * (double)TRACKING_SUBBUCKETS);
+  if (b >= TRACKING_BUCKETS) {
+    b = TRACKING_BUCKETS - 1;
+  }
+
+  return b;
+}
+
+static double bucket_lower(int b)
+{
+  if (b == 0) {
+    return 0.0;
+  }
+
+  return pow(2.0, (double)(b - 1)/(double)TRACKING_SUBBUCKETS)/1000.0;
+}
+
@@ -4,12 +4,24 @@
 
 #include <time.h>
 
+/*
+ * Durations are recorded in a histogram with TRACKING_SUBBUCKETS logarithmically spaced
+ * buckets per doubling from 1ns (up to about 20 minutes) so that percentiles are
+ * resolved to within about 9%.
+ */
+#define TRACKING_SUBBUCKETS 8
+#define TRACKING_OCTAVES 40
+#define TRACKING_BUCKETS (TRACKING_SUBBUCKETS * TRACKING_OCTAVES + 1)
+
 struct tracking {
   int n;
   double mean;
+  double total;
+  double maximum;
   int started;
   struct timespec start;
   struct timespec end;
+  int histogram[TRACKING_BUCKETS];
 };
 typedef struct tracking tracking_t;
 
@@ -19,10 +31,29 @@ int tracking_start(tracking_t *t);
 
 int tracking_end(tracking_t *t);
 
+/*
+ * Record a duration in microseconds timed elsewhere
+ */
+void tracking_add(tracking_t *t, double usec);
+
+/*
+ * Combine the samples of src into t, eg from different threads
+ */
+void tracking_merge(tracking_t *t, const tracking_t *src);
+
 void tracking_print(tracking_t *t, const char *label);
 
 int tracking_samples(tracking_t *t);
 
 double tracking_mean(tracking_t *t);
 
+double tracking_total(tracking_t *t);
+
+double tracking_maximum(tracking_t *t);
+
+/*
+ * Approximate duration below which a fraction p (0 .. 1) of the samples lie
+ */
+double tracking_percentile(tracking_t *t, double p);
+
 #endif /* tracking_h */
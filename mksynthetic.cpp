@@ -26,12 +26,15 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <getopt.h>
 
 #include "attenuationdataS2.hpp"
 #include "coordinate.hpp"
+#include "healpix.hpp"
 #include "rng.hpp"
+#include "syntheticgeometry.hpp"
 
 double synthetic_constant(double phi, double theta)
 {
@@ -97,12 +100,15 @@ std::map<std::string, synthetic_model_f> models = { {"Constant", synthetic_const
 						    {"NorthSouth", synthetic_northsouth},
 						    {"CubedSphere", synthetic_cubedsphere} };
 
-static char short_options[] = "i:o:O:I:m:ln:S:W:H:h";
+static char short_options[] = "i:o:O:g:p:I:m:ln:S:W:H:N:h";
 static struct option long_options[] = {
   {"input", required_argument, 0, 'i'},
   {"output", required_argument, 0, 'o'},
   {"output-true", required_argument, 0, 'O'},
 
+  {"generate", required_argument, 0, 'g'},
+  {"points", required_argument, 0, 'p'},
+
   {"model", required_argument, 0, 'm'},
   {"list-models", no_argument, 0, 'l'},
   
@@ -112,6 +118,7 @@ static struct option long_options[] = {
   {"image-output", required_argument, 0, 'I'},
   {"image-width", required_argument, 0, 'W'},
   {"image-height", required_argument, 0, 'H'},
+  {"image-nside", required_argument, 0, 'N'},
   
   {"help", no_argument, 0, 'h'},
   {0, 0, 0, 0}
@@ -129,11 +136,14 @@ int main(int argc, char *argv[])
   char *output_true;
   int seed;
   double noise_sigma;
+  int generate_paths;
+  int generate_points;
   std::string model_name;
 
   char *image_output;
   int image_width;
   int image_height;
+  int image_nside;
     
   //
   // Defaults
@@ -144,10 +154,13 @@ int main(int argc, char *argv[])
   output_true = nullptr;
   noise_sigma = 0.1;
   seed = 983;
+  generate_paths = 0;
+  generate_points = syntheticgeometry::DEFAULT_POINTS;
 
   image_output = nullptr;
   image_width = 128;
   image_height = 64;
+  image_nside = 0;
 
   option_index = 0;
   while (1) {
@@ -171,6 +184,22 @@ int main(int argc, char *argv[])
       output_true = optarg;
       break;
       
+    case 'g':
+      generate_paths = atoi(optarg);
+      if (generate_paths < 1) {
+	fprintf(stderr, "error: no. paths to generate must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
+    case 'p':
+      generate_points = atoi(optarg);
+      if (generate_points < 2) {
+	fprintf(stderr, "error: no. points per path must be 2 or greater\n");
+	return -1;
+      }
+      break;
+      
     case 'I':
       image_output = optarg;
       break;
@@ -217,6 +246,14 @@ int main(int argc, char *argv[])
       }
       break;
 
+    case 'N':
+      image_nside = atoi(optarg);
+      if (image_nside < 1) {
+	fprintf(stderr, "error: image nside must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
     case 'h':
     default:
       usage(argv[0]);
@@ -225,8 +262,13 @@ int main(int argc, char *argv[])
     }
   }
   
-  if (source_paths == nullptr) {
-    fprintf(stderr, "error: required parameter input not set\n");
+  if (source_paths == nullptr && generate_paths == 0) {
+    fprintf(stderr, "error: required parameter input (or generate) not set\n");
+    return -1;
+  }
+
+  if (source_paths != nullptr && generate_paths > 0) {
+    fprintf(stderr, "error: only one of input or generate may be set\n");
     return -1;
   }
 
@@ -234,6 +276,23 @@ int main(int argc, char *argv[])
     fprintf(stderr, "error: required parameter output not set\n");
     return -1;
   }
+
+  if (generate_paths > 0) {
+    //
+    // Random path geometry is written to the output first then read back and overwritten
+    // with the synthetic t*
+    //
+    Rng geometry(seed + 1);
+    if (!syntheticgeometry::write(output_file,
+				  std::vector<double>(generate_paths, 1.0),
+				  noise_sigma,
+				  generate_points,
+				  geometry)) {
+      fprintf(stderr, "error: failed to create output file\n");
+      return -1;
+    }
+    source_paths = output_file;
+  }
       
   attenuationdataS2<double> data(source_paths);
 
@@ -292,7 +351,30 @@ int main(int argc, char *argv[])
 
   fclose(fp_out);
 
-  if (image_output != nullptr) {
+  if (image_output != nullptr && image_nside > 0) {
+
+    healpix grid(image_nside);
+    std::vector<double> image(grid.npixels());
+
+    for (int p = 0; p < grid.npixels(); p ++) {
+
+      double imagephi, imagetheta;
+      grid.pix2ang(p, imagephi, imagetheta);
+
+      // -180 .. 180
+      if (imagetheta > M_PI) {
+	imagetheta -= 2.0 * M_PI;
+      }
+
+      image[p] = model(imagephi, imagetheta);
+    }
+
+    if (!grid.save(image_output, image.data())) {
+      fprintf(stderr, "error: failed to create image output file\n");
+      return -1;
+    }
+    
+  } else if (image_output != nullptr) {
 
     FILE *fp_image = fopen(image_output, "w");
     if (fp_image == NULL) {
@@ -333,6 +415,9 @@ static void usage(const char *pname)
 	  " -o | --output <filename>          Output file to write synthetic noisy observations to\n"
 	  " -O | --output-true <filename>     Output file to write synthetic true observations to\n"
 	  "\n"
+	  " -g | --generate <int>             Generate this many random paths instead of reading input\n"
+	  " -p | --points <int>               No. points per generated path (default 40)\n"
+	  "\n"
 	  " -m | --model <name>               Synthetic model to use\n"
 	  " -l | --list-models                List available synthetic models and exit\n"
 	  "\n"
@@ -342,6 +427,7 @@ static void usage(const char *pname)
 	  " -I | --image-output <filename>    Write synthetic model image\n"
 	  " -W | --image-width <int>          Image width\n"
 	  " -H | --image-height <int>         Image height\n"
+	  " -N | --image-nside <int>          Write the image as a HEALPix map with this nside\n"
 	  "\n"
 	  " -h | --help                       Usage\n"
 	  "\n",
@@ -40,7 +40,7 @@ public:
   typedef model_deltaVoronoi<coord_t, value> model_delta_t;
 
   MoveS2Voronoi() :
-    undo_cell(nullptr),
+    undo_index(-1),
     last_log_proposal_ratio(0.0),
     p(0),
     a(0)
@@ -109,9 +109,9 @@ public:
 
       cell_t *c = model.get_cell_by_index(cell);
       
-      undo_cell = c;
+      undo_index = cell;
       undo_coord = c->c;
-      c->c = newposition;
+      model.move_cell(cell, newposition);
 
       last_log_proposal_ratio =
 	position_prior.log_proposal_ratio(random,
@@ -140,22 +140,22 @@ public:
   {
     a ++;
     
-    if (undo_cell == nullptr) {
+    if (undo_index < 0) {
       throw ATTENUATIONEXCEPTION("No undo information\n");
     }
     
-    undo_cell = nullptr;
+    undo_index = -1;
   }
   
   void reject(sphericalvoronoimodel<value> &model)
   {
-    if (undo_cell == nullptr) {
+    if (undo_index < 0) {
       throw ATTENUATIONEXCEPTION("No undo information\n");
     }
 
-    undo_cell->c = undo_coord;
+    model.move_cell(undo_index, undo_coord);
     
-    undo_cell = nullptr;
+    undo_index = -1;
   }
   
   virtual int proposal_count() const
@@ -168,6 +168,21 @@ public:
     return a;
   }
 
+  virtual double get_scale(PriorProposal &prior,
+			   SphericalPriorProposal &position_prior,
+			   PriorProposal &hierarchical_prior)
+  {
+    return position_prior.get_proposal()->get_scale();
+  }
+
+  virtual void set_scale(PriorProposal &prior,
+			 SphericalPriorProposal &position_prior,
+			 PriorProposal &hierarchical_prior,
+			 double scale)
+  {
+    position_prior.get_proposal()->set_scale(scale);
+  }
+
   virtual const char *displayname() const
   {
     return "Move";
@@ -175,7 +190,7 @@ public:
   
 private:
   
-  cell_t *undo_cell;
+  int undo_index;
   coord_t undo_coord;
 
   double last_log_proposal_ratio;
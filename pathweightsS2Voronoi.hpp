@@ -0,0 +1,543 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef pathweightsS2Voronoi_hpp
+#define pathweightsS2Voronoi_hpp
+
+#include <vector>
+
+#include "attenuationdataS2.hpp"
+#include "sphericaldelaunay.hpp"
+#include "sphericalvoronoimodel.hpp"
+
+//
+// The predicted t* of a path is linear in 1/Q: for a fixed tessellation it is
+//
+//   t*_p = sum_c W[p, c]/Q_c
+//
+// where W[p, c] is the sum of distance/vp over the points of path p lying in cell c. This
+// maintains the sparse W for a range of paths, stored both by path and by cell, together with
+// the cell owning each point and the predictions.
+//
+// Geometry changes are replayed from the model's journal against a private copy of the
+// triangulation so that only the points of the changed cell and its natural neighbours are
+// relocated. Value changes are found by comparing 1/Q of each cell with the last seen value
+// and update only the paths crossing the cell. Rejected proposals are undone in the model
+// and so are replayed in the same way.
+//
+template
+<
+  typename value
+>
+class pathweightsS2Voronoi {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef vector3<value> vector_t;
+  typedef typename sphericalvoronoimodel<value>::edit_t edit_t;
+
+  //
+  // A non-zero W[p, c], index is the cell in the by path storage and the path in the by cell
+  // storage, mirror is the position of the same entry in the other storage.
+  //
+  struct entry_t {
+    entry_t(int _index, value _w, int _mirror) :
+      index(_index),
+      w(_w),
+      n(1),
+      mirror(_mirror)
+    {
+    }
+
+    int index;
+    value w;
+    int n;
+    int mirror;
+  };
+
+  pathweightsS2Voronoi(const attenuationdataS2<value> &data, int _offset, int _size) :
+    offset(_offset),
+    size(_size),
+    refresh_interval(1000),
+    updates(0)
+  {
+    for (int p = 0; p < size; p ++) {
+      const pathS2<value> &path = data.data[offset + p];
+
+      path_start.push_back((int)points.size());
+      tstar.push_back(path.tstar);
+      noise.push_back(path.noise);
+
+      for (int i = 0; i < (int)path.points.size(); i ++) {
+	const dataS2<value> &d = path.points[i];
+	points.push_back(path.cartesian[i]);
+	point_path.push_back(p);
+	weight.push_back(d.distance/d.vp);
+      }
+    }
+    path_start.push_back((int)points.size());
+  }
+
+  //
+  // Bring the weights and predictions up to date with the model
+  //
+  void update(sphericalvoronoimodel<value> &model)
+  {
+    model.take_journal(edits);
+
+    for (auto &e : edits) {
+      switch (e.kind) {
+      case sphericalvoronoimodel<value>::EDIT_INSERT:
+	insert_cell(e.index, e.c);
+	break;
+
+      case sphericalvoronoimodel<value>::EDIT_REMOVE:
+	remove_cell(e.index);
+	break;
+
+      case sphericalvoronoimodel<value>::EDIT_MOVE:
+	move_cell(e.index, e.c);
+	break;
+
+      case sphericalvoronoimodel<value>::EDIT_RESET:
+	rebuild(model);
+	break;
+      }
+    }
+
+    if ((int)centres.size() != model.ncells()) {
+      throw ATTENUATIONEXCEPTION("Path weights out of step with model: %d %d\n",
+				 (int)centres.size(),
+				 model.ncells());
+    }
+
+    //
+    // Value changes
+    //
+    for (int c = 0; c < (int)invQ.size(); c ++) {
+      value q = 1.0/model.cell_value(c);
+      if (q != invQ[c]) {
+	value dq = q - invQ[c];
+	for (auto &e : by_cell[c]) {
+	  prediction[e.index] += e.w * dq;
+	}
+	invQ[c] = q;
+      }
+    }
+
+    //
+    // Bound the round off accumulated by the incremental updates
+    //
+    updates ++;
+    if (updates >= refresh_interval) {
+      refresh();
+    }
+  }
+
+  //
+  // Negative log likelihood and residuals over the range of paths, after update
+  //
+  value likelihood(double lambda, value *residuals) const
+  {
+    value sum = 0.0;
+
+    for (int p = 0; p < size; p ++) {
+      value res = prediction[p] - tstar[p];
+      double sigma = noise[p] * lambda;
+
+      residuals[p] = res;
+      
+      sum += res*res/(2.0 * sigma * sigma);
+    }
+
+    return sum;
+  }
+
+  value predicted_tstar(int p) const
+  {
+    return prediction[p];
+  }
+
+  //
+  // With the other cells fixed the misfit is quadratic in s = 1/Q of cell c, ie
+  // precision/2 (s - mean)^2 + const. Computes the partial sums of precision and
+  // precision * mean over this range of paths, after update.
+  //
+  void conditional(int c, double lambda, value &precision, value &weighted_mean) const
+  {
+    precision = 0.0;
+    weighted_mean = 0.0;
+
+    for (auto &e : by_cell[c]) {
+      int p = e.index;
+      double sigma = noise[p] * lambda;
+      value rest = prediction[p] - e.w * invQ[c];
+
+      precision += e.w * e.w/(sigma * sigma);
+      weighted_mean += e.w * (tstar[p] - rest)/(sigma * sigma);
+    }
+  }
+
+  //
+  // W in compressed sparse row form by path (rows are paths, columns are cells) for
+  // linearised analyses
+  //
+  void matrix_by_path(std::vector<int> &rowptr, std::vector<int> &cells, std::vector<value> &w) const
+  {
+    compress(by_path, rowptr, cells, w);
+  }
+
+  //
+  // W in compressed sparse row form by cell (rows are cells, columns are paths)
+  //
+  void matrix_by_cell(std::vector<int> &rowptr, std::vector<int> &paths, std::vector<value> &w) const
+  {
+    compress(by_cell, rowptr, paths, w);
+  }
+
+  //
+  // Paths crossing cell c and their weights
+  //
+  const std::vector<entry_t> &paths_through(int c) const
+  {
+    return by_cell[c];
+  }
+
+private:
+
+  static void compress(const std::vector<std::vector<entry_t>> &rows,
+		       std::vector<int> &rowptr,
+		       std::vector<int> &index,
+		       std::vector<value> &w)
+  {
+    rowptr.clear();
+    index.clear();
+    w.clear();
+
+    rowptr.push_back(0);
+    for (auto &r : rows) {
+      for (auto &e : r) {
+	index.push_back(e.index);
+	w.push_back(e.w);
+      }
+      rowptr.push_back((int)index.size());
+    }
+  }
+
+  void rebuild(const sphericalvoronoimodel<value> &model)
+  {
+    int n = model.ncells();
+    
+    model.cartesian_cells(centres, invQ);
+    for (auto &q : invQ) {
+      q = 0.0;
+    }
+    
+    triangulation.rebuild(centres);
+
+    by_cell.assign(n, std::vector<entry_t>());
+    by_path.assign(size, std::vector<entry_t>());
+    cell_points.assign(n, std::vector<int>());
+    prediction.assign(size, 0.0);
+    
+    owner.assign(points.size(), -1);
+    owner_slot.assign(points.size(), -1);
+
+    int hint = 0;
+    for (int i = 0; i < (int)points.size(); i ++) {
+      hint = locate(points[i], hint);
+      assign(i, hint);
+    }
+
+    updates = 0;
+  }
+
+  //
+  // Recompute the predictions from W, the values are already current
+  //
+  void refresh()
+  {
+    for (int p = 0; p < size; p ++) {
+      value t = 0.0;
+      for (auto &e : by_path[p]) {
+	t += e.w * invQ[e.index];
+      }
+      prediction[p] = t;
+    }
+
+    updates = 0;
+  }
+
+  void insert_cell(int index, const coord_t &c)
+  {
+    vector_t v;
+    coord_t::sphericaltocartesian(c.phi, c.theta, v);
+
+    shift_cells(index, 1);
+
+    centres.insert(centres.begin() + index, v);
+    invQ.insert(invQ.begin() + index, 0.0);
+    by_cell.insert(by_cell.begin() + index, std::vector<entry_t>());
+    cell_points.insert(cell_points.begin() + index, std::vector<int>());
+    triangulation.insert(index, v);
+
+    //
+    // The new cell takes its region from its natural neighbours
+    //
+    candidates.clear();
+    neighbour_points(index);
+    relocate();
+  }
+
+  void remove_cell(int index)
+  {
+    candidates = cell_points[index];
+    for (auto i : candidates) {
+      unassign(i);
+    }
+
+    shift_cells(index + 1, -1);
+
+    centres.erase(centres.begin() + index);
+    invQ.erase(invQ.begin() + index);
+    by_cell.erase(by_cell.begin() + index);
+    cell_points.erase(cell_points.begin() + index);
+    triangulation.remove(index);
+
+    relocate();
+  }
+
+  void move_cell(int index, const coord_t &c)
+  {
+    vector_t v;
+    coord_t::sphericaltocartesian(c.phi, c.theta, v);
+
+    candidates = cell_points[index];
+    
+    centres[index] = v;
+    triangulation.move(index, v);
+
+    neighbour_points(index);
+    relocate();
+  }
+
+  //
+  // Add the points owned by the natural neighbours of cell c to the candidates, or all
+  // points if the triangulation is unavailable
+  //
+  void neighbour_points(int c)
+  {
+    if (triangulation.is_valid()) {
+      triangulation.neighbours(c, nn);
+      for (auto j : nn) {
+	candidates.insert(candidates.end(), cell_points[j].begin(), cell_points[j].end());
+      }
+    } else {
+      for (int i = 0; i < (int)points.size(); i ++) {
+	candidates.push_back(i);
+      }
+    }
+  }
+
+  void relocate()
+  {
+    int hint = 0;
+    for (auto i : candidates) {
+      if (owner[i] >= 0) {
+	hint = owner[i];
+      }
+      
+      int c = locate(points[i], hint);
+      if (c != owner[i]) {
+	if (owner[i] >= 0) {
+	  unassign(i);
+	}
+	assign(i, c);
+      }
+      hint = c;
+    }
+  }
+
+  //
+  // Cell indices from first onwards change by delta
+  //
+  void shift_cells(int first, int delta)
+  {
+    for (auto &r : by_path) {
+      for (auto &e : r) {
+	if (e.index >= first) {
+	  e.index += delta;
+	}
+      }
+    }
+
+    for (auto &o : owner) {
+      if (o >= first) {
+	o += delta;
+      }
+    }
+  }
+
+  int locate(const vector_t &x, int hint) const
+  {
+    if (triangulation.is_valid()) {
+      return triangulation.nearest(x, hint);
+    }
+
+    int best = 0;
+    value bestdot = x.dot(centres[0]);
+    for (int c = 1; c < (int)centres.size(); c ++) {
+      value d = x.dot(centres[c]);
+      if (d > bestdot) {
+	best = c;
+	bestdot = d;
+      }
+    }
+
+    return best;
+  }
+
+  void assign(int i, int c)
+  {
+    int p = point_path[i];
+    value w = weight[i];
+
+    owner[i] = c;
+    owner_slot[i] = (int)cell_points[c].size();
+    cell_points[c].push_back(i);
+
+    std::vector<entry_t> &row = by_path[p];
+    int j = find(row, c);
+    if (j < 0) {
+      row.push_back(entry_t(c, w, (int)by_cell[c].size()));
+      by_cell[c].push_back(entry_t(p, w, (int)row.size() - 1));
+    } else {
+      entry_t &e = row[j];
+      e.w += w;
+      e.n ++;
+      by_cell[c][e.mirror].w += w;
+      by_cell[c][e.mirror].n ++;
+    }
+
+    prediction[p] += w * invQ[c];
+  }
+
+  void unassign(int i)
+  {
+    int c = owner[i];
+    int p = point_path[i];
+    value w = weight[i];
+
+    //
+    // Swap remove from the cell's point list
+    //
+    std::vector<int> &cp = cell_points[c];
+    int slot = owner_slot[i];
+    cp[slot] = cp.back();
+    owner_slot[cp[slot]] = slot;
+    cp.pop_back();
+
+    owner[i] = -1;
+    owner_slot[i] = -1;
+
+    std::vector<entry_t> &row = by_path[p];
+    int j = find(row, c);
+    entry_t &e = row[j];
+    int k = e.mirror;
+
+    e.n --;
+    if (e.n == 0) {
+      erase(row, j, by_cell);
+      erase(by_cell[c], k, by_path);
+    } else {
+      e.w -= w;
+      by_cell[c][k].w -= w;
+      by_cell[c][k].n --;
+    }
+
+    prediction[p] -= w * invQ[c];
+  }
+
+  static int find(const std::vector<entry_t> &row, int index)
+  {
+    for (int j = 0; j < (int)row.size(); j ++) {
+      if (row[j].index == index) {
+	return j;
+      }
+    }
+
+    return -1;
+  }
+
+  //
+  // Swap remove entry j of row fixing the mirror of the moved entry in the other storage
+  //
+  static void erase(std::vector<entry_t> &row, int j, std::vector<std::vector<entry_t>> &other)
+  {
+    if (j != (int)row.size() - 1) {
+      row[j] = row.back();
+      other[row[j].index][row[j].mirror].mirror = j;
+    }
+    row.pop_back();
+  }
+
+  int offset;
+  int size;
+
+  //
+  // Flattened points of the range of paths
+  //
+  std::vector<vector_t> points;
+  std::vector<int> point_path;
+  std::vector<value> weight;
+  std::vector<int> path_start;
+  std::vector<value> tstar;
+  std::vector<value> noise;
+
+  //
+  // Tessellation as last seen
+  //
+  std::vector<vector_t> centres;
+  std::vector<value> invQ;
+  sphericaldelaunay<value> triangulation;
+
+  std::vector<int> owner;
+  std::vector<int> owner_slot;
+  std::vector<std::vector<int>> cell_points;
+
+  std::vector<std::vector<entry_t>> by_path;
+  std::vector<std::vector<entry_t>> by_cell;
+  std::vector<value> prediction;
+
+  int refresh_interval;
+  int updates;
+
+  std::vector<edit_t> edits;
+  std::vector<int> candidates;
+  std::vector<int> nn;
+};
+
+#endif // pathweightsS2Voronoi_hpp
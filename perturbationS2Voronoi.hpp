@@ -28,6 +28,8 @@
 
 #include <mpi.h>
 
+#include <vector>
+
 #include "rng.hpp"
 #include "prior.hpp"
 #include "sphericalprior.hpp"
@@ -36,6 +38,7 @@
 #include "sphericalvoronoimodel.hpp"
 
 #include "chainhistoryVoronoi.hpp"
+#include "instrumentation.hpp"
 
 template
 <
@@ -55,7 +58,8 @@ public:
   PerturbationS2Voronoi() :
     communicator(MPI_COMM_NULL),
     rank(-1),
-    size(-1)
+    size(-1),
+    discards(0)
   {
   }
   
@@ -94,10 +98,46 @@ public:
 
   virtual void reject(sphericalvoronoimodel<value> &model) = 0;
 
+  //
+  // Abandon a proposal whose outcome is never used, ie speculative proposals evaluated
+  // beyond the first acceptance. A valid proposal is undone and in either case the
+  // proposal is excluded from the acceptance statistics.
+  //
+  void discard(sphericalvoronoimodel<value> &model, bool valid)
+  {
+    if (valid) {
+      reject(model);
+    }
+    discards ++;
+  }
+
+  int discard_count() const
+  {
+    return discards;
+  }
+
   virtual int proposal_count() const = 0;
   
   virtual int acceptance_count() const = 0;
 
+  //
+  // Width of the proposal this perturbation draws from for adaptive tuning, zero if it has
+  // none that can be tuned.
+  //
+  virtual double get_scale(PriorProposal &prior,
+			   SphericalPriorProposal &position_prior,
+			   PriorProposal &hierarchical_prior)
+  {
+    return 0.0;
+  }
+
+  virtual void set_scale(PriorProposal &prior,
+			 SphericalPriorProposal &position_prior,
+			 PriorProposal &hierarchical_prior,
+			 double scale)
+  {
+  }
+
   virtual const char *displayname() const = 0;
 
 protected:
@@ -116,7 +156,9 @@ protected:
   {
     if (communicator != MPI_COMM_NULL) {
       int i = (int)b;
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(&i, 1, MPI_INT, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
       b = (bool)i;
     }
   }
@@ -124,7 +166,9 @@ protected:
   void communicate(int &i)
   {
     if (communicator != MPI_COMM_NULL) {
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(&i, 1, MPI_INT, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
     }
   }
   
@@ -132,18 +176,35 @@ protected:
   {
     if (communicator != MPI_COMM_NULL) {
       double t = (double)d;
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(&t, 1, MPI_DOUBLE, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
       d = t;
     }
   }
 
+  //
+  // Sum partial results over the processes sharing the observations
+  //
+  void reduce(double *v, int n)
+  {
+    if (communicator != MPI_COMM_NULL) {
+      std::vector<double> t(v, v + n);
+      INSTRUMENT_START(COLLECTIVE);
+      MPI_Allreduce(t.data(), v, n, MPI_DOUBLE, MPI_SUM, communicator);
+      INSTRUMENT_END(COLLECTIVE);
+    }
+  }
+
   void communicate(coord_t &p)
   {
     if (communicator != MPI_COMM_NULL) {
       double t[2];
       t[0] = p.phi;
       t[1] = p.theta;
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(t, 2, MPI_DOUBLE, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
       p.phi = t[0];
       p.theta = t[1];
     }
@@ -154,7 +215,8 @@ private:
   MPI_Comm communicator;
   int rank;
   int size;
-  
+
+  int discards;
 
 };
 
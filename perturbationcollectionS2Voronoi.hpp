@@ -29,6 +29,8 @@
 #include "globalS2Voronoi.hpp"
 #include "chainhistoryVoronoi.hpp"
 #include "perturbationS2Voronoi.hpp"
+#include "aliastable.hpp"
+#include "instrumentation.hpp"
 
 template
 <typename value>
@@ -43,8 +45,9 @@ public:
     communicator(MPI_COMM_NULL),
     rank(-1),
     size(-1),
-    weight_sum(0.0),
-    active(-1)
+    active(-1),
+    last(-1),
+    adaptations(0)
   {
   }
   
@@ -68,8 +71,13 @@ public:
       throw ATTENUATIONEXCEPTION("Invalid weight: %f\n", weight);
     }
     
-    weight_sum += weight;
     perturbations.push_back(WeightedPerturbation(p, weight));
+
+    std::vector<double> weights;
+    for (auto &wp : perturbations) {
+      weights.push_back(wp.w);
+    }
+    selection.build(weights);
   }
 
   bool propose(globalS2Voronoi<value> &g, double &log_prior_ratio, delta_t *&perturbation)
@@ -79,33 +87,25 @@ public:
     }
     
     if (primary()) {
-      double u = g.random.uniform();
-      active = 0;
-      for (auto &wp: perturbations) {
-	double w = wp.w/weight_sum;
-	
-	if (u < w) {
-	  break;
-	} else {
-	  active ++;
-	  u -= w;
-	}
-      }
-    
-      if (active >= (int)perturbations.size()) {
+      if (perturbations.empty()) {
 	throw ATTENUATIONEXCEPTION("Failed to determine active perturbation\n");
       }
+      
+      active = selection.sample(g.random.uniform());
     }
 
     communicate(active);
+    last = active;
     
     WeightedPerturbation &wp = perturbations[active];
+    INSTRUMENT_CATEGORY(wp.p->displayname());
     
     int nobs = 0;
     if (g.data != nullptr) {
       nobs = g.data->data.size();
     }
 
+    INSTRUMENT_START(PROPOSE);
     bool r = wp.p->propose(g.maxcells,
 			   nobs,
 			   g.random,
@@ -117,6 +117,7 @@ public:
 			   g.temperature,
 			   log_prior_ratio,
 			   perturbation);
+    INSTRUMENT_END(PROPOSE);
     if (!r) {
       active = -1;
     }
@@ -167,19 +168,129 @@ public:
   }
   
 
+  //
+  // Discard the last proposal, valid or not, so that it does not count as an iteration
+  //
+  void discard(globalS2Voronoi<value> &g)
+  {
+    if (last < 0 || last >= (int)perturbations.size()) {
+      throw ATTENUATIONEXCEPTION("Invalid last perturbation %d\n", last);
+    }
+
+    WeightedPerturbation &wp = perturbations[last];
+    wp.p->discard(*g.model, active >= 0);
+
+    active = -1;
+  }
+
+  //
+  // Adjust the proposal widths toward a target acceptance rate using the acceptance since
+  // the last adjustment of each perturbation. The log of each width is moved by the
+  // difference from the target with a gain that decreases with the number of adjustments
+  // so that the widths settle. This changes the transition kernel so must only be used
+  // during burn in, see adaptation.
+  //
+  void adapt(globalS2Voronoi<value> &g, double target)
+  {
+    adaptations ++;
+    double gain = 1.0/sqrt((double)adaptations);
+
+    for (auto &wp : perturbations) {
+
+      double scale = wp.p->get_scale(*g.prior, *g.positionprior, *g.hierarchicalprior);
+      if (scale <= 0.0) {
+	continue;
+      }
+
+      if (primary()) {
+	int p = wp.p->proposal_count() - wp.p->discard_count();
+	int a = wp.p->acceptance_count();
+
+	int dp = p - wp.adapted_proposals;
+	if (dp >= MINIMUM_ADAPTATION_PROPOSALS) {
+	  double rate = (double)(a - wp.adapted_acceptances)/(double)dp;
+	  
+	  scale *= exp(gain * (rate - target));
+
+	  wp.adapted_proposals = p;
+	  wp.adapted_acceptances = a;
+	}
+      }
+
+      communicate(scale);
+      wp.p->set_scale(*g.prior, *g.positionprior, *g.hierarchicalprior, scale);
+    }
+  }
+
+  //
+  // Current widths of the tunable proposals with the perturbation names for logging and
+  // recording in the chain history.
+  //
+  void adaptation(globalS2Voronoi<value> &g,
+		  std::vector<std::string> &names,
+		  std::vector<double> &scales)
+  {
+    names.clear();
+    scales.clear();
+    
+    for (auto &wp : perturbations) {
+
+      double scale = wp.p->get_scale(*g.prior, *g.positionprior, *g.hierarchicalprior);
+      if (scale > 0.0) {
+	names.push_back(wp.p->displayname());
+	scales.push_back(scale);
+      }
+    }
+  }
+
+  std::string generateadaptationreport(globalS2Voronoi<value> &g)
+  {
+    std::vector<std::string> names;
+    std::vector<double> scales;
+    std::string s;
+    char linebuffer[1024];
+
+    adaptation(g, names, scales);
+    for (int i = 0; i < (int)names.size(); i ++) {
+      sprintf(linebuffer, "  %12s: %12.6g\n", names[i].c_str(), scales[i]);
+      s += linebuffer;
+    }
+
+    return s;
+  }
+
   void writeacceptancereport(FILE *fp)
   {
     fprintf(fp, "%s", generateacceptancereport().c_str());
   }
 
   std::string generateacceptancereport()
+  {
+    std::vector<PerturbationCollectionS2Voronoi<value>*> collections;
+
+    collections.push_back(this);
+    return generateacceptancereport(collections);
+  }
+
+  //
+  // Combined report over collections with the same perturbations, eg per thread copies
+  //
+  static std::string generateacceptancereport(const std::vector<PerturbationCollectionS2Voronoi<value>*> &collections)
   {
     std::string s;
     char linebuffer[1024];
-    
-    for (auto &wp: perturbations) {
-      int p = wp.p->proposal_count();
-      int a = wp.p->acceptance_count();
+
+    for (int i = 0; i < (int)collections[0]->perturbations.size(); i ++) {
+      int p = 0;
+      int a = 0;
+
+      for (auto &c : collections) {
+	PerturbationS2Voronoi<value> *pp = c->perturbations[i].p;
+	p += pp->proposal_count() - pp->discard_count();
+	a += pp->acceptance_count();
+      }
+      
+      const WeightedPerturbation &wp = collections[0]->perturbations[i];
       
       double f = 0.0;
       if (p > 0) {
@@ -204,36 +315,50 @@ private:
   void communicate(int &i)
   {
     if (communicator != MPI_COMM_NULL) {
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(&i, 1, MPI_INT, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
     }
   }
 
   void communicate(double &d)
   {
     if (communicator != MPI_COMM_NULL) {
+      INSTRUMENT_START(COLLECTIVE);
       MPI_Bcast(&d, 1, MPI_DOUBLE, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
     }
   }
   
 
+  static const int MINIMUM_ADAPTATION_PROPOSALS = 20;
+
   struct WeightedPerturbation {
     WeightedPerturbation(PerturbationS2Voronoi<value> *_p, double _w) :
       p(_p),
-      w(_w)
+      w(_w),
+      adapted_proposals(0),
+      adapted_acceptances(0)
     {
     }
     
     PerturbationS2Voronoi<value> *p;
     double w;
+
+    int adapted_proposals;
+    int adapted_acceptances;
   };
 
   MPI_Comm communicator;
   int rank;
   int size;
   
-  double weight_sum;
+  aliastable selection;
   std::vector<WeightedPerturbation> perturbations;
   int active;
+  int last;
+
+  int adaptations;
 
 };
 
@@ -31,6 +31,8 @@
 
 #include "coordinate.hpp"
 #include "sphericalvoronoimodel.hpp"
+#include "sphericalvoronoiraster.hpp"
+#include "healpix.hpp"
 #include "chainhistoryVoronoi.hpp"
 
 #include "pathutil.hpp"
@@ -38,7 +40,7 @@
 typedef sphericalcoordinate<double> coord_t;
 typedef chainhistoryreaderVoronoi<coord_t, double> chainhistoryreader_t;
 
-static char short_options[] = "i:fo:m:M:T:V:e:E:g:b:I:z:Z:W:H:t:s:Lh";
+static char short_options[] = "i:fo:m:M:T:V:e:E:g:b:I:z:Z:W:H:n:t:s:Lh";
 static struct option long_options[] = {
   {"input", required_argument, 0, 'i'},
   {"fake", required_argument, 0, 'f'},
@@ -60,6 +62,7 @@ static struct option long_options[] = {
 
   {"lonsamples", required_argument, 0, 'W'},
   {"latsamples", required_argument, 0, 'H'},
+  {"nside", required_argument, 0, 'n'},
   
   {"thin", required_argument, 0, 't'},
   {"skip", required_argument, 0, 's'},
@@ -78,7 +81,7 @@ static double median_from_histogram(int *hist, double vmin, double vmax, int bin
 static double head_from_histogram(int *hist, double vmin, double vmax, int bins, int drop);
 static double tail_from_histogram(int *hist, double vmin, double vmax, int bins, int drop);
 
-static int saveimage(const char *filename, double *image, int width, int height);
+static int saveimage(const char *filename, double *image, int width, int height, int nside);
 
 int main(int argc, char *argv[])
 {
@@ -87,6 +90,7 @@ int main(int argc, char *argv[])
   
   int lonsamples;
   int latsamples;
+  int nside;
   
   //
   // Chain processing
@@ -150,6 +154,7 @@ int main(int argc, char *argv[])
 
   lonsamples = 16;
   latsamples = 16;
+  nside = 0;
   
   input = nullptr;
   fake = 0;
@@ -259,6 +264,14 @@ int main(int argc, char *argv[])
       }
       break;
 
+    case 'n':
+      nside = atoi(optarg);
+      if (nside < 1) {
+	fprintf(stderr, "error: nside must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
     case 'z':
       histmin = atof(optarg);
       break;
@@ -302,8 +315,13 @@ int main(int argc, char *argv[])
   // Initialize state
   //
   histogram = nullptr;
-  histrows = lonsamples;
-  histcols = latsamples;
+  if (nside > 0) {
+    histrows = healpix(nside).npixels();
+    histcols = 1;
+  } else {
+    histrows = lonsamples;
+    histcols = latsamples;
+  }
   
   histsize = histrows * histcols * histbins;
   histogram = new int[histsize];
@@ -313,7 +331,11 @@ int main(int argc, char *argv[])
 			  
 
   meann = 0;
-  imagesize = lonsamples * latsamples;
+  if (nside > 0) {
+    imagesize = healpix(nside).npixels();
+  } else {
+    imagesize = lonsamples * latsamples;
+  }
   mean = new double[imagesize];
   image = new double[imagesize];
   variance = new double[imagesize];
@@ -329,20 +351,37 @@ int main(int argc, char *argv[])
     //
     // Fake the sub-sampled image
     //
-    for (int j = 0; j < latsamples; j ++) {
-      
-      // North Pole to South Pole
-      double imagephi = ((double)j + 0.5)/(double)latsamples * M_PI;
-      double lat = 90.0 - imagephi * 180.0/M_PI;
+    if (nside > 0) {
+      healpix grid(nside);
       
-      for (int i = 0; i < lonsamples; i ++) {
+      for (int p = 0; p < imagesize; p ++) {
+	double imagephi, imagetheta;
+	grid.pix2ang(p, imagephi, imagetheta);
 	
-	// -180 .. 180
-	double imagetheta = ((double)i + 0.5)/(double)lonsamples * 2.0 * M_PI - M_PI;
+	double lat = 90.0 - imagephi * 180.0/M_PI;
 	double lon = imagetheta * 180.0/M_PI;
-	      
-	mean[j * lonsamples + i] = 500.0 * exp(-((lat + 35.0)*(lat + 35.0) + (lon - 140.0)*(lon - 140.0))/(2.0 * 10.0 * 10.0));
-	      
+	if (lon > 180.0) {
+	  lon -= 360.0;
+	}
+	
+	mean[p] = 500.0 * exp(-((lat + 35.0)*(lat + 35.0) + (lon - 140.0)*(lon - 140.0))/(2.0 * 10.0 * 10.0));
+      }
+    } else {
+      for (int j = 0; j < latsamples; j ++) {
+	
+	// North Pole to South Pole
+	double imagephi = ((double)j + 0.5)/(double)latsamples * M_PI;
+	double lat = 90.0 - imagephi * 180.0/M_PI;
+	
+	for (int i = 0; i < lonsamples; i ++) {
+	  
+	  // -180 .. 180
+	  double imagetheta = ((double)i + 0.5)/(double)lonsamples * 2.0 * M_PI - M_PI;
+	  double lon = imagetheta * 180.0/M_PI;
+	  
+	  mean[j * lonsamples + i] = 500.0 * exp(-((lat + 35.0)*(lat + 35.0) + (lon - 140.0)*(lon - 140.0))/(2.0 * 10.0 * 10.0));
+	  
+	}
       }
     }
 
@@ -355,6 +394,11 @@ int main(int argc, char *argv[])
     sphericalvoronoimodel<double> model(logspace);
     singlescaling_hierarchical_model hierarchical;
     double likelihood;
+
+    sphericalvoronoiraster<double> raster = (nside > 0) ?
+      sphericalvoronoiraster<double>(healpix(nside)) :
+      sphericalvoronoiraster<double>(lonsamples, latsamples);
+    model.enable_triangulation();
     
     int status = reader.step(model, hierarchical, likelihood);
     int step = 0;
@@ -366,19 +410,7 @@ int main(int argc, char *argv[])
 	  //
 	  // Compute the sub-sampled image
 	  //
-	  for (int j = 0; j < latsamples; j ++) {
-	    
-	    // North Pole to South Pole
-	    double imagephi = ((double)j + 0.5)/(double)latsamples * M_PI;
-	    for (int i = 0; i < lonsamples; i ++) {
-	      
-	      // -180 .. 180
-	      double imagetheta = ((double)i + 0.5)/(double)lonsamples * 2.0 * M_PI - M_PI;
-	      
-	      image[j * lonsamples + i] = model.value_at_point(coord_t(imagephi, imagetheta));
-	      
-	    }
-	  }
+	  raster.render(model, image);
 	  
 	  //
 	  // Update mean/variance and hist counts
@@ -436,7 +468,7 @@ int main(int argc, char *argv[])
     //
     // Always save the mean
     //
-    if (saveimage(output, mean, lonsamples, latsamples) < 0) {
+    if (saveimage(output, mean, lonsamples, latsamples, nside) < 0) {
       fprintf(stderr, "error: failed to save mean\n");
       return -1;
     }
@@ -454,7 +486,7 @@ int main(int argc, char *argv[])
     }
 
     if (variance_file != nullptr) {
-      if (saveimage(variance_file, variance, lonsamples, latsamples) < 0) {
+      if (saveimage(variance_file, variance, lonsamples, latsamples, nside) < 0) {
 	fprintf(stderr, "error: failed to save variance\n");
 	return -1;
       }
@@ -465,7 +497,7 @@ int main(int argc, char *argv[])
 	variance[i] = sqrt(variance[i]);
       }
       
-      if (saveimage(stddev_file, variance, lonsamples, latsamples) < 0) {
+      if (saveimage(stddev_file, variance, lonsamples, latsamples, nside) < 0) {
 	fprintf(stderr, "error: failed to save std dev\n");
 	return -1;
       }
@@ -514,7 +546,7 @@ int main(int argc, char *argv[])
 	image[i] = median_from_histogram(histogram + i * histbins, histmin, histmax, histbins);
       }
       
-      if (saveimage(median_file, image, lonsamples, latsamples) < 0) {
+      if (saveimage(median_file, image, lonsamples, latsamples, nside) < 0) {
 	fprintf(stderr, "error: failed to save median\n");
 	return -1;
       }
@@ -527,7 +559,7 @@ int main(int argc, char *argv[])
 	image[i] = mode_from_histogram(histogram + i * histbins, histmin, histmax, histbins);
       }
 
-      if (saveimage(mode_file, image, lonsamples, latsamples) < 0) {
+      if (saveimage(mode_file, image, lonsamples, latsamples, nside) < 0) {
 	fprintf(stderr, "error: failed to save median\n");
 	return -1;
       }
@@ -540,7 +572,7 @@ int main(int argc, char *argv[])
 	image[i] = head_from_histogram(histogram + i * histbins, histmin, histmax, histbins, credible_drop);
       }
       
-      if (saveimage(credmin_file, image, lonsamples, latsamples) < 0) {
+      if (saveimage(credmin_file, image, lonsamples, latsamples, nside) < 0) {
 	fprintf(stderr, "error: failed to save credible min\n");
 	return -1;
       }
@@ -553,7 +585,7 @@ int main(int argc, char *argv[])
 	image[i] = tail_from_histogram(histogram + i * histbins, histmin, histmax, histbins, credible_drop);
       }
       
-      if (saveimage(credmax_file, image, lonsamples, latsamples) < 0) {
+      if (saveimage(credmax_file, image, lonsamples, latsamples, nside) < 0) {
 	fprintf(stderr, "error: failed to save credible max\n");
 	return -1;
       }
@@ -599,6 +631,7 @@ static void usage(const char *pname)
 	  "\n"
 	  " -W|--lonsamples <int>       No. samples in longitude direction\n"
 	  " -H|--latsamples <int>       No. samples in latitude direction\n"
+	  " -n|--nside <int>            Output HEALPix maps with this nside instead\n"
 	  "\n"
 	  " -t|--thin <int>             Only use every nth model\n"
 	  " -s|--skip <int>             Skip first n models\n"
@@ -696,10 +729,18 @@ static double tail_from_histogram(int *hist, double vmin, double vmax, int bins,
   return ((double)i + 0.5)/(double)bins * (vmax - vmin) + vmin;
 }
 
-static int saveimage(const char *filename, double *image, int width, int height)
+static int saveimage(const char *filename, double *image, int width, int height, int nside)
 {
   FILE *fp;
 
+  if (nside > 0) {
+    healpix grid(nside);
+    if (!grid.save(filename, image)) {
+      return -1;
+    }
+    return 0;
+  }
+
   fp = fopen(filename, "w");
   if (fp == NULL) {
     return -1;
@@ -31,15 +31,6 @@
 
 std::map<std::string, Prior::prior_reader_f> Prior::readers;
 
-static double
-newtonsolve(double (*f)(double x),
-	    double (*fprime)(double x),
-	    double xmin,
-	    double xmax,
-	    double y,
-	    double threshold,
-	    int maxsteps);
-
 Prior::Prior()
 {
 }
@@ -48,6 +39,13 @@ Prior::~Prior()
 {
 }
 
+void
+Prior::support(double &vmin, double &vmax)
+{
+  vmin = -HUGE_VAL;
+  vmax = HUGE_VAL;
+}
+
 Prior *
 Prior::load(FILE *fp)
 {
@@ -104,6 +102,17 @@ Proposal::get_prior()
   return &prior;
 }
 
+double
+Proposal::get_scale()
+{
+  return 0.0;
+}
+
+void
+Proposal::set_scale(double scale)
+{
+}
+
 Proposal*
 Proposal::load(FILE *fp, Prior &prior)
 {
@@ -252,6 +261,13 @@ UniformPrior::valid(double v)
   return (v >= vmin && v <= vmax);
 }
 
+void
+UniformPrior::support(double &_vmin, double &_vmax)
+{
+  _vmin = vmin;
+  _vmax = vmax;
+}
+
 double
 UniformPrior::sample(Rng &rng)
 {
@@ -283,6 +299,7 @@ const bool CosinePrior::REGISTRATION = Prior::register_prior("Cosine", CosinePri
 
 CosinePrior::CosinePrior()
 {
+  table.build(cdf, cdfprime, nullptr, -1.0, 1.0);
 }
 
 CosinePrior::~CosinePrior()
@@ -294,28 +311,34 @@ CosinePrior::valid(double v)
 {
   return (v > -1.0) && (v < 1.0);
 }
+
+void
+CosinePrior::support(double &_vmin, double &_vmax)
+{
+  _vmin = -1.0;
+  _vmax = 1.0;
+}
   
 double
 CosinePrior::sample(Rng &rng)
 {
-  //
-  // CDF is 0.5*(1/M_PI * sin(M_PI * t) + t + 1.0)
-  // Gradient is 0.5*(cos(M_PI * t) + 1.0)
-  //
-  // Can generate uniform t and then use newton method to find root of CDF - t
-  //
-  auto cdf = [](double x) -> double { return 0.5 * (sin(M_PI * x)/M_PI + x + 1.0); };
-  auto pdf = [](double x) -> double { return 0.5 * (cos(M_PI * x) + 1.0); };
+  return table.sample(rng.uniform());
+}
 
-  double u = rng.uniform();
+//
+// CDF is 0.5*(1/M_PI * sin(M_PI * t) + t + 1.0)
+// Gradient is 0.5*(cos(M_PI * t) + 1.0)
+//
+double
+CosinePrior::cdf(void *user, double x)
+{
+  return 0.5 * (sin(M_PI * x)/M_PI + x + 1.0);
+}
 
-  return newtonsolve(cdf,
-		     pdf,
-		     -1.0,
-		     1.0,
-		     u,
-		     1.0e-9,
-		     1000);
+double
+CosinePrior::cdfprime(void *user, double x)
+{
+  return 0.5 * (cos(M_PI * x) + 1.0);
 }
 
 double
@@ -381,6 +404,13 @@ JeffreysPrior::valid(double v)
 {
   return (v >= vmin && v <= vmax);
 }
+
+void
+JeffreysPrior::support(double &_vmin, double &_vmax)
+{
+  _vmin = vmin;
+  _vmax = vmax;
+}
   
 double
 JeffreysPrior::sample(Rng &rng)
@@ -482,6 +512,13 @@ LogNormalPrior::valid(double v)
 {
   return v > 0.0;
 }
+
+void
+LogNormalPrior::support(double &_vmin, double &_vmax)
+{
+  _vmin = 0.0;
+  _vmax = HUGE_VAL;
+}
   
 double
 LogNormalPrior::sample(Rng &rng)
@@ -642,54 +679,16 @@ GaussianProposal::log_proposal_ratio(Rng &rng,
   return 0.0;
 }
 
+double
+GaussianProposal::get_scale()
+{
+  return std;
+}
 
-
-static double
-newtonsolve(double (*f)(double x),
-	    double (*fprime)(double x),
-	    double xmin,
-	    double xmax,
-	    double y,
-	    double threshold,
-	    int maxsteps)
-{
-  double x = (xmin + xmax)/2.0;
-  double yt = f(x);
-  int i;
-
-  i = 0;
-  while ((i < maxsteps) && (fabs(yt - y) > threshold)) {
-
-    double g = fprime(x);
-    double dx;
-    
-    if (g == 0.0) {
-      //
-      // Since the cdf's should be monotonicly increasing, this should only happen at the boundaries
-      //
-      if (y < yt) {
-	dx = 1.0e-6;
-      } else {
-	dx = -1.0e-6;
-      }
-    } else {
-      dx = (y - yt)/g;
-    }
-
-    x += dx;
-    if (x < xmin) {
-      x = xmin + threshold;
-    }
-    if (x > xmax) {
-      x = xmax - threshold;
-    }
-
-    yt = f(x);
-
-    i ++;
-  }
-
-  return x;
+void
+GaussianProposal::set_scale(double scale)
+{
+  std = scale;
 }
 
 
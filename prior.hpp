@@ -30,6 +30,7 @@
 #include <string>
 
 #include "rng.hpp"
+#include "inversecdftable.hpp"
 
 class Prior {
 public:
@@ -45,6 +46,11 @@ public:
 
   virtual double logpdf(double v) = 0;
 
+  //
+  // Interval outside of which the pdf is zero, unbounded by default
+  //
+  virtual void support(double &vmin, double &vmax);
+
   static Prior *load(FILE *fp);
 
   typedef Prior* (*prior_reader_f)(FILE *fp);
@@ -81,6 +87,13 @@ public:
 				    double oldv,
 				    double newv) = 0;
 
+  //
+  // Width of the proposal for adaptive tuning, zero for proposals that have no width to
+  // tune in which case set_scale is ignored.
+  //
+  virtual double get_scale();
+  virtual void set_scale(double scale);
+
   static Proposal* load(FILE *fp, Prior &prior);
 
   typedef Proposal* (*proposal_reader_f)(FILE *fp, Prior &prior);
@@ -156,6 +169,8 @@ public:
 
   virtual double logpdf(double v);
 
+  virtual void support(double &vmin, double &vmax);
+
   static Prior* reader(FILE *fp);
   
 private:
@@ -180,11 +195,18 @@ public:
 
   virtual double logpdf(double v);
 
+  virtual void support(double &vmin, double &vmax);
+
   static Prior* reader(FILE *fp);
   
 private:
 
+  static double cdf(void *user, double x);
+  static double cdfprime(void *user, double x);
+
   static const bool REGISTRATION;
+
+  inversecdftable table;
   
 };
   
@@ -227,6 +249,8 @@ public:
 
   virtual double logpdf(double v);
 
+  virtual void support(double &vmin, double &vmax);
+
   static Prior* reader(FILE *fp);
   
 private:
@@ -256,6 +280,8 @@ public:
 
   virtual double logpdf(double v);
 
+  virtual void support(double &vmin, double &vmax);
+
   static Prior* reader(FILE *fp);
   
 private:
@@ -321,6 +347,9 @@ public:
 				    double oldv,
 				    double newv);
 
+  virtual double get_scale();
+  virtual void set_scale(double scale);
+
   static Proposal *read(FILE *fp, Prior &prior);
 
 private:
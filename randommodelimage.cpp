@@ -29,17 +29,20 @@
 
 #include "coordinate.hpp"
 #include "sphericalvoronoimodel.hpp"
+#include "sphericalvoronoiraster.hpp"
+#include "healpix.hpp"
 #include "rng.hpp"
 #include "sphericalprior.hpp"
 
 typedef sphericalcoordinate<double> coord_t;
 
-static char short_options[] = "i:o:W:H:N:v:V:h";
+static char short_options[] = "i:o:W:H:n:N:v:V:h";
 
 static struct option long_options[] = {
   {"output", required_argument, 0, 'o'},
   {"lonsamples", required_argument, 0, 'W'},
   {"latsamples", required_argument, 0, 'H'},
+  {"nside", required_argument, 0, 'n'},
   {"points", required_argument, 0, 'N'},
   {"vmin", required_argument, 0, 'v'},
   {"vmax", required_argument, 0, 'V'},
@@ -50,7 +53,7 @@ static struct option long_options[] = {
 
 static void usage(const char *pname);
 
-static int saveimage(const char *filename, double *image, int width, int height);
+static int saveimage(const char *filename, double *image, int width, int height, int nside);
 
 int main(int argc, char *argv[])
 {
@@ -59,6 +62,7 @@ int main(int argc, char *argv[])
   
   int lonsamples;
   int latsamples;
+  int nside;
   
   //
   // Output Files
@@ -81,6 +85,7 @@ int main(int argc, char *argv[])
 
   lonsamples = 16;
   latsamples = 16;
+  nside = 0;
 
   output = nullptr;
 
@@ -118,6 +123,14 @@ int main(int argc, char *argv[])
       }
       break;
 
+    case 'n':
+      nside = atoi(optarg);
+      if (nside < 1) {
+	fprintf(stderr, "error: nside must be 1 or greater\n");
+	return -1;
+      }
+      break;
+
     case 'N':
       npoints = atoi(optarg);
       if (npoints <= 0) {
@@ -148,7 +161,11 @@ int main(int argc, char *argv[])
     return -1;
   }
 
-  imagesize = lonsamples * latsamples;
+  if (nside > 0) {
+    imagesize = healpix(nside).npixels();
+  } else {
+    imagesize = lonsamples * latsamples;
+  }
   image = new double[imagesize];
 
   sphericalvoronoimodel<double> model(false);
@@ -166,25 +183,17 @@ int main(int argc, char *argv[])
     model.add_cell(coord_t(phi, theta), v);
   }
   
+  model.enable_triangulation();
   
-  for (int j = 0; j < latsamples; j ++) {
-    
-    // North Pole to South Pole
-    double imagephi = ((double)j + 0.5)/(double)latsamples * M_PI;
-    for (int i = 0; i < lonsamples; i ++) {
-      
-      // -180 .. 180
-      double imagetheta = ((double)i + 0.5)/(double)lonsamples * 2.0 * M_PI - M_PI;
-      
-      image[j * lonsamples + i] = model.value_at_point(coord_t(imagephi, imagetheta));
-      
-    }
-  }
+  sphericalvoronoiraster<double> raster = (nside > 0) ?
+    sphericalvoronoiraster<double>(healpix(nside)) :
+    sphericalvoronoiraster<double>(lonsamples, latsamples);
+  raster.render(model, image);
   
   //
   // Always save the mean
   //
-  if (saveimage(output, image, lonsamples, latsamples) < 0) {
+  if (saveimage(output, image, lonsamples, latsamples, nside) < 0) {
     fprintf(stderr, "error: failed to save mean\n");
     return -1;
   }
@@ -210,6 +219,7 @@ static void usage(const char *pname)
 	  "\n"
 	  " -W|--lonsamples <int>       No. samples in longitude direction\n"
 	  " -H|--latsamples <int>       No. samples in latitude direction\n"
+	  " -n|--nside <int>            Output a HEALPix map with this nside instead\n"
 	  "\n"
 	  "\n"
 	  " -h|--help                   Usage\n"
@@ -218,10 +228,18 @@ static void usage(const char *pname)
 }
 
 
-static int saveimage(const char *filename, double *image, int width, int height)
+static int saveimage(const char *filename, double *image, int width, int height, int nside)
 {
   FILE *fp;
 
+  if (nside > 0) {
+    healpix grid(nside);
+    if (!grid.save(filename, image)) {
+      return -1;
+    }
+    return 0;
+  }
+
   fp = fopen(filename, "w");
   if (fp == NULL) {
     return -1;
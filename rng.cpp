@@ -24,6 +24,8 @@
 
 #include "rng.hpp"
 
+#include <math.h>
+
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 
@@ -130,6 +132,62 @@ Rng::gamma(double a, double b)
   return gsl_ran_gamma(pimpl->rng, a, b);
 }
 
+//
+// Rejection sampling of the standard normal on (a, b) after Robert (1995), from the normal
+// itself, a uniform or an exponential depending on where the interval lies so that the
+// acceptance rate stays bounded even far into the tails.
+//
+double
+Rng::truncated_normal(double mean, double sigma, double lo, double hi)
+{
+  double a = (lo - mean)/sigma;
+  double b = (hi - mean)/sigma;
+  double sign = 1.0;
+
+  if (!(a < b)) {
+    return lo;
+  }
+
+  if (b <= 0.0) {
+    double t = a;
+    a = -b;
+    b = -t;
+    sign = -1.0;
+  }
+
+  double z;
+  
+  if (a <= 0.0) {
+
+    if (b - a < 2.5) {
+      do {
+	z = a + (b - a) * uniform();
+      } while (uniform() > exp(-0.5 * z * z));
+    } else {
+      do {
+	z = normal(1.0);
+      } while (z <= a || z >= b);
+    }
+    
+  } else {
+
+    double alpha = 0.5 * (a + sqrt(a * a + 4.0));
+
+    if (b - a < 1.0/alpha) {
+      do {
+	z = a + (b - a) * uniform();
+      } while (uniform() > exp(0.5 * (a * a - z * z)));
+    } else {
+      do {
+	z = a - log(1.0 - uniform())/alpha;
+      } while (z >= b || uniform() > exp(-0.5 * (z - alpha) * (z - alpha)));
+    }
+    
+  }
+
+  return mean + sign * sigma * z;
+}
+
 double
 Rng::pdf_normal(double x, double mean, double sigma)
 {
@@ -53,6 +53,11 @@ public:
   double normal(double sigma);
   double gamma(double a, double b);
 
+  //
+  // Normal restricted to lo < x < hi (either may be infinite)
+  //
+  double truncated_normal(double mean, double sigma, double lo, double hi);
+
   //
   // PDF
   //
@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+#
+# Strong and weak scaling of attenuationtomoS2VoronoiPT under a local mpirun.
+#
+# Synthetic observations are generated with mksynthetic (random ray paths through the upper
+# inner core with t* from one of its synthetic models), then each configuration of chains
+# and processes per chain is run for a fixed number of iterations. For strong scaling the
+# number of paths is fixed, for weak scaling it grows in proportion to the processes per
+# chain. The iterations/second of each chain are read from the log and the time spent in MPI
+# collectives from instrumentation.txt when the programs are built with -DINSTRUMENTATION.
+#
+# eg
+#
+#   scripts/scaling.py --paths 2000 --ranks 1,2,4 --chains 1,2 --iterations 2000
+#
+
+import argparse
+import glob
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+
+PRIOR = """prior LogNormal
+5.8 1.0
+proposal Gaussian
+2.0e1
+"""
+
+POSITION_PRIOR = """sphericalprior UniformSpherical
+sphericalproposal VonMisesSpherical
+1.0e1
+"""
+
+RATE = re.compile(r'Chain (\d+): (\d+) iterations in ([0-9.]+) seconds')
+
+def intlist(s):
+    return [int(x) for x in s.split(',')]
+
+def write_text(filename, text):
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def generate(args, npaths, workdir):
+    filename = os.path.join(workdir, 'paths_%d.txt' % npaths)
+    if not os.path.exists(filename):
+        subprocess.check_call([os.path.join(args.bindir, 'mksynthetic'),
+                               '-g', str(npaths),
+                               '-p', str(args.points),
+                               '-m', args.model,
+                               '-n', str(args.noise),
+                               '-S', str(args.seed),
+                               '-o', filename])
+    return filename
+
+def collective_seconds(output):
+    """Total time in MPI collectives over all processes, None if not instrumented"""
+    files = glob.glob(output + 'instrumentation.txt-*')
+    if not files:
+        return None
+
+    total = 0.0
+    for filename in files:
+        with open(filename) as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) == 9 and fields[1] == 'collective':
+                    total += float(fields[8])
+
+    return total * 1.0e-6
+
+def run(args, data, chains, ranks, workdir, prior, position_prior):
+    nprocesses = chains * ranks
+    output = os.path.join(workdir, 'run_%d_%d_%d/' % (chains, ranks, os.path.getsize(data)))
+    os.makedirs(output, exist_ok=True)
+
+    command = shlex.split(args.mpirun) + ['-np', str(nprocesses),
+                                          os.path.join(args.bindir, 'attenuationtomoS2VoronoiPT'),
+                                          '-i', data,
+                                          '-o', output,
+                                          '-P', prior,
+                                          '-M', position_prior,
+                                          '-t', str(args.iterations),
+                                          '-v', '0',
+                                          '-c', str(chains)] + shlex.split(args.extra)
+
+    t0 = time.time()
+    subprocess.check_call(command, stdout=subprocess.DEVNULL)
+    wall = time.time() - t0
+
+    #
+    # The first process of each chain logs the time of its sampling loop
+    #
+    rates = []
+    loop = 0.0
+    for filename in glob.glob(output + 'log.txt-*'):
+        with open(filename) as f:
+            for line in f:
+                m = RATE.search(line)
+                if m:
+                    rates.append(float(m.group(2))/float(m.group(3)))
+                    loop = max(loop, float(m.group(3)))
+
+    if len(rates) != chains:
+        sys.stderr.write('error: found timings for %d of %d chains in %s\n' % (len(rates), chains, output))
+        sys.exit(1)
+
+    comm = collective_seconds(output)
+    if comm is not None:
+        comm = comm/(nprocesses * loop)
+
+    return {'chains' : chains,
+            'ranks' : ranks,
+            'processes' : nprocesses,
+            'rate' : sum(rates)/len(rates),
+            'throughput' : sum(rates),
+            'wall' : wall,
+            'comm' : comm}
+
+def sweep(args, kind, workdir, prior, position_prior):
+    results = []
+    for chains in args.chains:
+        baseline = None
+        for ranks in args.ranks:
+            if kind == 'strong':
+                npaths = args.paths
+            else:
+                npaths = args.paths * ranks
+            data = generate(args, npaths, workdir)
+
+            r = run(args, data, chains, ranks, workdir, prior, position_prior)
+            r['paths'] = npaths
+
+            #
+            # Ideal strong scaling divides the time of an iteration by the processes per
+            # chain, ideal weak scaling keeps it constant
+            #
+            if baseline is None:
+                baseline = r
+            speedup = r['rate']/baseline['rate']
+            if kind == 'strong':
+                r['efficiency'] = speedup * baseline['ranks']/ranks
+            else:
+                r['efficiency'] = speedup
+
+            results.append(r)
+            report(kind, r, len(results) == 1)
+
+    return results
+
+def report(kind, r, header):
+    if header:
+        print('\n%s scaling' % kind.capitalize())
+        print('%6s %6s %6s %8s %12s %12s %10s %8s %10s' %
+              ('chains', 'ranks', 'procs', 'paths', 'it/s/chain', 'it/s total',
+               'efficiency', 'comm', 'wall (s)'))
+
+    if r['comm'] is None:
+        comm = '-'
+    else:
+        comm = '%.1f%%' % (100.0 * r['comm'])
+
+    print('%6d %6d %6d %8d %12.2f %12.2f %9.1f%% %8s %10.2f' %
+          (r['chains'], r['ranks'], r['processes'], r['paths'], r['rate'], r['throughput'],
+           100.0 * r['efficiency'], comm, r['wall']))
+    sys.stdout.flush()
+
+def write_csv(filename, results):
+    with open(filename, 'w') as f:
+        f.write('kind,chains,ranks,processes,paths,iterations_per_second,throughput,efficiency,comm_fraction,wall\n')
+        for kind, r in results:
+            f.write('%s,%d,%d,%d,%d,%.6f,%.6f,%.6f,%s,%.3f\n' %
+                    (kind, r['chains'], r['ranks'], r['processes'], r['paths'], r['rate'],
+                     r['throughput'], r['efficiency'],
+                     '' if r['comm'] is None else '%.6f' % r['comm'], r['wall']))
+
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(description = 'Strong/weak scaling of attenuationtomoS2VoronoiPT')
+
+    parser.add_argument('--kind', choices = ['strong', 'weak', 'both'], default = 'both',
+                        help = 'Scaling sweeps to run')
+    parser.add_argument('--paths', type = int, default = 1000,
+                        help = 'No. paths (strong) or paths per process per chain (weak)')
+    parser.add_argument('--points', type = int, default = 40, help = 'No. points per path')
+    parser.add_argument('--model', default = 'CubedSphere', help = 'mksynthetic model')
+    parser.add_argument('--noise', type = float, default = 0.01, help = 'Synthetic noise std dev')
+    parser.add_argument('--seed', type = int, default = 983, help = 'Random seed')
+
+    parser.add_argument('--ranks', type = intlist, default = [1, 2, 4],
+                        help = 'Comma separated no. processes per chain')
+    parser.add_argument('--chains', type = intlist, default = [1],
+                        help = 'Comma separated no. chains')
+    parser.add_argument('--iterations', type = int, default = 1000, help = 'Iterations per run')
+
+    parser.add_argument('--prior', help = 'Prior file (default LogNormal values)')
+    parser.add_argument('--position-prior', help = 'Position prior file (default uniform)')
+    parser.add_argument('--extra', default = '', help = 'Extra options for the sampler')
+
+    parser.add_argument('--mpirun', default = 'mpirun', help = 'MPI launcher and its options')
+    parser.add_argument('--bindir', default = os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+                        help = 'Directory of the programs')
+    parser.add_argument('--workdir', help = 'Directory for data and outputs (default temporary)')
+    parser.add_argument('--csv', help = 'Write the results to this CSV file')
+
+    args = parser.parse_args()
+
+    workdir = args.workdir
+    if workdir is None:
+        workdir = tempfile.mkdtemp(prefix = 'scaling')
+    os.makedirs(workdir, exist_ok = True)
+
+    prior = args.prior
+    if prior is None:
+        prior = os.path.join(workdir, 'prior.txt')
+        write_text(prior, PRIOR)
+
+    position_prior = args.position_prior
+    if position_prior is None:
+        position_prior = os.path.join(workdir, 'position_prior.txt')
+        write_text(position_prior, POSITION_PRIOR)
+
+    results = []
+    for kind in ['strong', 'weak']:
+        if args.kind in (kind, 'both'):
+            results += [(kind, r) for r in sweep(args, kind, workdir, prior, position_prior)]
+
+    if args.csv is not None:
+        write_csv(args.csv, results)
+
+    print('\nOutputs in %s' % workdir)
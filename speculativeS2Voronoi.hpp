@@ -0,0 +1,372 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#pragma once
+#ifndef speculativeS2Voronoi_hpp
+#define speculativeS2Voronoi_hpp
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "globalS2Voronoi.hpp"
+#include "perturbationcollectionS2Voronoi.hpp"
+
+//
+// Speculative evaluation of the Metropolis loop. Each of a number of threads owns a replica
+// of the current state and evaluates an independent proposal from it. The proposals are
+// then resolved in sequence order: those before the first acceptance are rejections, the
+// first acceptance is applied and the remainder are discarded. As each proposal is
+// independent and made from the current state, this is identical in distribution to the
+// sequential chain.
+//
+// There may be more proposals than threads, in which case each thread evaluates the
+// likelihoods of its proposals together in one pass over the data.
+//
+template
+<typename value>
+class SpeculativeS2Voronoi {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef deltaVoronoi<coord_t, value> delta_t;
+  typedef PerturbationCollectionS2Voronoi<value> collection_t;
+
+  typedef std::function<void(collection_t &pc, globalS2Voronoi<value> &g)> builder_f;
+
+  SpeculativeS2Voronoi(globalS2Voronoi<value> &_global,
+		       int nslots,
+		       int nthreads,
+		       int seed,
+		       bool _earlyreject,
+		       builder_f builder) :
+    global(_global),
+    earlyreject(_earlyreject),
+    nworkers(nthreads),
+    nactive(0),
+    accepted(-1),
+    current_likelihood(0.0),
+    generation(0),
+    pending(0),
+    shutdown(false)
+  {
+    if (nthreads < 1 || nslots < nthreads) {
+      throw ATTENUATIONEXCEPTION("Invalid no. threads/proposals: %d %d\n", nthreads, nslots);
+    }
+
+    for (int i = 0; i < nslots; i ++) {
+      globalS2Voronoi<value> *g = new globalS2Voronoi<value>(global, seed + i + 1);
+      collection_t *pc = new collection_t();
+      builder(*pc, *g);
+
+      replicas.push_back(g);
+      collections.push_back(pc);
+      slots.push_back(slot_t());
+    }
+
+    errors.resize(nthreads);
+
+    //
+    // The calling thread does the work of the first thread
+    //
+    for (int i = 1; i < nthreads; i ++) {
+      threads.push_back(std::thread(&SpeculativeS2Voronoi<value>::worker, this, i));
+    }
+  }
+
+  ~SpeculativeS2Voronoi()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shutdown = true;
+    }
+    start.notify_all();
+
+    for (auto &t : threads) {
+      t.join();
+    }
+
+    for (auto &pc : collections) {
+      delete pc;
+    }
+
+    for (auto &g : replicas) {
+      delete g;
+    }
+  }
+
+  int nslots() const
+  {
+    return (int)replicas.size();
+  }
+
+  //
+  // Evaluate n proposals in parallel from the current state and return the number of
+  // iterations consumed, ie up to and including the first acceptance.
+  //
+  int evaluate(int n, double _current_likelihood)
+  {
+    if (n < 1 || n > nslots()) {
+      throw ATTENUATIONEXCEPTION("Invalid no. speculative proposals: %d\n", n);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      nactive = n;
+      current_likelihood = _current_likelihood;
+      pending = nworkers - 1;
+      generation ++;
+    }
+    start.notify_all();
+
+    run(0);
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [this] { return pending == 0; });
+    }
+
+    for (auto &e : errors) {
+      if (e) {
+	std::rethrow_exception(e);
+      }
+    }
+
+    accepted = -1;
+    for (int i = 0; i < n; i ++) {
+      if (slots[i].accepted) {
+	accepted = i;
+	break;
+      }
+    }
+
+    if (accepted < 0) {
+      return n;
+    }
+
+    //
+    // Proposals after the first acceptance never happened in the sequential chain
+    //
+    for (int i = accepted + 1; i < n; i ++) {
+      collections[i]->discard(*replicas[i]);
+      delete slots[i].perturbation;
+      slots[i].perturbation = nullptr;
+    }
+
+    return accepted + 1;
+  }
+
+  //
+  // Apply the outcome of slot i to the global state, must be called in order for each
+  // iteration consumed. Returns the perturbation for the chain history and updates the
+  // current likelihood on acceptance.
+  //
+  delta_t *resolve(int i, double &_current_likelihood)
+  {
+    slot_t &s = slots[i];
+
+    if (s.valid) {
+      if (i == accepted) {
+
+	collections[i]->accept(*replicas[i]);
+	s.perturbation->accept();
+
+	//
+	// The global state takes on the accepted proposal and its residuals
+	//
+	globalS2Voronoi<value> &g = *replicas[i];
+	global.synchronise(g);
+	for (int j = 0; j < global.residual_size; j ++) {
+	  global.residuals[j] = g.residuals[j];
+	}
+	global.accept();
+
+	_current_likelihood = s.proposed_likelihood;
+
+	for (int j = 0; j < nslots(); j ++) {
+	  if (j != i) {
+	    replicas[j]->synchronise(g);
+	  }
+	}
+
+      } else {
+
+	collections[i]->reject(*replicas[i]);
+	s.perturbation->reject();
+	global.reject();
+
+      }
+    }
+
+    delta_t *perturbation = s.perturbation;
+    s.perturbation = nullptr;
+    return perturbation;
+  }
+
+  std::string generateacceptancereport()
+  {
+    return collection_t::generateacceptancereport(collections);
+  }
+
+private:
+
+  struct slot_t {
+    slot_t() :
+      valid(false),
+      accepted(false),
+      u(0.0),
+      log_ratio(0.0),
+      proposed_likelihood(0.0),
+      perturbation(nullptr)
+    {
+    }
+
+    bool valid;
+    bool accepted;
+    double u;
+    double log_ratio;
+    double proposed_likelihood;
+    delta_t *perturbation;
+  };
+
+  //
+  // Thread t handles every nworkers'th slot starting from t
+  //
+  void run(int t)
+  {
+    errors[t] = nullptr;
+
+    try {
+      std::vector<int> valid;
+      
+      for (int i = t; i < nactive; i += nworkers) {
+	slot_t &s = slots[i];
+	globalS2Voronoi<value> &g = *replicas[i];
+	collection_t &pc = *collections[i];
+	double log_prior_ratio;
+	
+	s.accepted = false;
+	s.perturbation = nullptr;
+	s.valid = pc.propose(g, log_prior_ratio, s.perturbation);
+	
+	if (s.valid) {
+	  if (s.perturbation == nullptr) {
+	    throw ATTENUATIONEXCEPTION("Valid proposal has null perturbation\n");
+	  }
+
+	  s.u = log(g.random.uniform());
+	  s.log_ratio = log_prior_ratio + pc.log_proposal_ratio(g);
+
+	  valid.push_back(i);
+	}
+      }
+
+      if (earlyreject) {
+	for (auto i : valid) {
+	  slot_t &s = slots[i];
+	  bool complete;
+
+	  s.proposed_likelihood = replicas[i]->likelihood(current_likelihood + s.log_ratio - s.u, complete);
+	  s.accepted = complete && s.u < (current_likelihood - s.proposed_likelihood + s.log_ratio);
+	}
+      } else {
+	std::vector<globalS2Voronoi<value>*> instances;
+	std::vector<value> likelihoods(valid.size());
+	
+	for (auto i : valid) {
+	  instances.push_back(replicas[i]);
+	}
+	
+	globalS2Voronoi<value>::likelihood_batch(instances.size(), instances.data(), likelihoods.data());
+
+	for (int j = 0; j < (int)valid.size(); j ++) {
+	  slot_t &s = slots[valid[j]];
+	  
+	  s.proposed_likelihood = likelihoods[j];
+	  s.accepted = s.u < (current_likelihood - s.proposed_likelihood + s.log_ratio);
+	}
+      }
+
+      for (auto i : valid) {
+	slots[i].perturbation->set_proposed_likelihood(slots[i].proposed_likelihood);
+      }
+      
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  }
+
+  void worker(int i)
+  {
+    int seen = 0;
+
+    while (true) {
+      {
+	std::unique_lock<std::mutex> lock(mutex);
+	start.wait(lock, [this, seen] { return shutdown || generation != seen; });
+	if (shutdown) {
+	  return;
+	}
+	seen = generation;
+      }
+
+      run(i);
+
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending --;
+	if (pending == 0) {
+	  done.notify_one();
+	}
+      }
+    }
+  }
+
+  globalS2Voronoi<value> &global;
+  bool earlyreject;
+  int nworkers;
+
+  std::vector<globalS2Voronoi<value>*> replicas;
+  std::vector<collection_t*> collections;
+  std::vector<slot_t> slots;
+  std::vector<std::exception_ptr> errors;
+
+  int nactive;
+  int accepted;
+  double current_likelihood;
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  int generation;
+  int pending;
+  bool shutdown;
+
+};
+
+#endif // speculativeS2Voronoi_hpp
@@ -0,0 +1,489 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef sphericaldelaunay_hpp
+#define sphericaldelaunay_hpp
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "coordinate.hpp"
+
+//
+// Incrementally maintained Delaunay triangulation of points on the unit sphere, ie the dual
+// of the spherical Voronoi tessellation. As all the points lie on the sphere, this is their
+// convex hull: insertion replaces the faces visible from the new point with a fan from the
+// horizon, deletion fills the hole with the faces of the hull of the link of the point that
+// are visible from the point.
+//
+// Points are identified by index and indices shift on insertion/deletion in the same way as
+// the cells of the model. With fewer than 4 points or in degenerate configurations the
+// triangulation is marked invalid, and is rebuilt from scratch on the next modification.
+//
+template
+<
+  typename value
+>
+class sphericaldelaunay {
+public:
+
+  typedef vector3<value> vector_t;
+
+  sphericaldelaunay() :
+    valid(false)
+  {
+  }
+
+  void clear()
+  {
+    points.clear();
+    incident.clear();
+    triangles.clear();
+    freelist.clear();
+    valid = false;
+  }
+
+  int size() const
+  {
+    return (int)points.size();
+  }
+
+  bool is_valid() const
+  {
+    return valid;
+  }
+
+  //
+  // Replace all points and triangulate from scratch
+  //
+  void rebuild(const std::vector<vector_t> &_points)
+  {
+    points = _points;
+    rebuild();
+  }
+
+  //
+  // Insert a point at index, points from index onward move up by one
+  //
+  void insert(int index, const vector_t &p)
+  {
+    for (auto &t : triangles) {
+      for (int k = 0; k < 3; k ++) {
+	if (t.v[k] >= index) {
+	  t.v[k] ++;
+	}
+      }
+    }
+
+    points.insert(points.begin() + index, p);
+    incident.insert(incident.begin() + index, std::vector<int>());
+
+    if (valid) {
+      attach(index);
+    }
+
+    if (!valid) {
+      rebuild();
+    }
+  }
+
+  //
+  // Remove the point at index, points after index move down by one
+  //
+  void remove(int index)
+  {
+    if (valid) {
+      detach(index);
+    }
+
+    if (valid) {
+      for (auto &t : triangles) {
+	for (int k = 0; k < 3; k ++) {
+	  if (t.v[k] > index) {
+	    t.v[k] --;
+	  }
+	}
+      }
+
+      incident.erase(incident.begin() + index);
+      points.erase(points.begin() + index);
+    } else {
+      points.erase(points.begin() + index);
+      rebuild();
+    }
+  }
+
+  //
+  // Move the point at index, the index is unchanged
+  //
+  void move(int index, const vector_t &p)
+  {
+    if (valid) {
+      detach(index);
+    }
+
+    points[index] = p;
+
+    if (valid) {
+      attach(index);
+    }
+
+    if (!valid) {
+      rebuild();
+    }
+  }
+
+  //
+  // The natural neighbours of a point, ie those whose Voronoi cells share an edge with it
+  //
+  void neighbours(int index, std::vector<int> &nn) const
+  {
+    nn.clear();
+
+    if (!valid) {
+      return;
+    }
+
+    for (auto t : incident[index]) {
+      for (int k = 0; k < 3; k ++) {
+	int j = triangles[t].v[k];
+	if (j != index && std::find(nn.begin(), nn.end(), j) == nn.end()) {
+	  nn.push_back(j);
+	}
+      }
+    }
+  }
+
+  //
+  // Nearest point to p by walking from start: if a point is not the nearest then one of its
+  // Delaunay neighbours is nearer, so a greedy walk terminates at the nearest point. p need
+  // not be of unit length.
+  //
+  int nearest(const vector_t &p, int start) const
+  {
+    int current = start;
+    value best = p.dot(points[current]);
+    bool improved = true;
+
+    while (improved) {
+      improved = false;
+      int next = current;
+
+      for (auto t : incident[current]) {
+	for (int k = 0; k < 3; k ++) {
+	  int j = triangles[t].v[k];
+	  value d = p.dot(points[j]);
+	  if (d > best) {
+	    best = d;
+	    next = j;
+	    improved = true;
+	  }
+	}
+      }
+
+      current = next;
+    }
+
+    return current;
+  }
+
+private:
+
+  //
+  // Triangles are oriented anti-clockwise when viewed from outside the sphere
+  //
+  struct triangle_t {
+    int v[3];
+    vector_t normal;
+    value offset;
+    bool alive;
+  };
+
+  static constexpr double EPSILON = 1.0e-12;
+
+  value orientation(const triangle_t &t, const vector_t &p) const
+  {
+    return t.normal.dot(p) - t.offset;
+  }
+
+  int add_triangle(int a, int b, int c)
+  {
+    int i;
+    if (freelist.empty()) {
+      i = (int)triangles.size();
+      triangles.push_back(triangle_t());
+    } else {
+      i = freelist.back();
+      freelist.pop_back();
+    }
+
+    triangle_t &t = triangles[i];
+    t.v[0] = a;
+    t.v[1] = b;
+    t.v[2] = c;
+    t.normal = cross(points[b] - points[a], points[c] - points[a]);
+    t.offset = t.normal.dot(points[a]);
+    t.alive = true;
+
+    for (int k = 0; k < 3; k ++) {
+      incident[t.v[k]].push_back(i);
+    }
+
+    return i;
+  }
+
+  void remove_triangle(int i)
+  {
+    triangle_t &t = triangles[i];
+
+    for (int k = 0; k < 3; k ++) {
+      std::vector<int> &inc = incident[t.v[k]];
+      inc.erase(std::find(inc.begin(), inc.end(), i));
+    }
+
+    t.alive = false;
+    freelist.push_back(i);
+  }
+
+  //
+  // Add point index (already in points but not in the triangulation) to the hull
+  //
+  void attach(int index)
+  {
+    const vector_t &p = points[index];
+
+    std::vector<int> visible;
+    for (int i = 0; i < (int)triangles.size(); i ++) {
+      if (triangles[i].alive && orientation(triangles[i], p) > EPSILON) {
+	visible.push_back(i);
+      }
+    }
+
+    //
+    // The horizon is the directed edges of visible faces whose reverse is not visible
+    //
+    std::vector<std::pair<int, int>> edges;
+    for (auto i : visible) {
+      const triangle_t &t = triangles[i];
+      for (int k = 0; k < 3; k ++) {
+	edges.push_back(std::pair<int, int>(t.v[k], t.v[(k + 1) % 3]));
+      }
+    }
+
+    std::vector<std::pair<int, int>> horizon;
+    std::vector<int> starts;
+    for (auto &e : edges) {
+      if (std::find(edges.begin(), edges.end(), std::pair<int, int>(e.second, e.first)) == edges.end()) {
+	horizon.push_back(e);
+	starts.push_back(e.first);
+      }
+    }
+
+    //
+    // The visible region must be a disk with no interior vertices
+    //
+    std::sort(starts.begin(), starts.end());
+    if (visible.empty() ||
+	visible.size() + 2 != horizon.size() ||
+	std::unique(starts.begin(), starts.end()) != starts.end()) {
+      valid = false;
+      return;
+    }
+
+    for (auto i : visible) {
+      remove_triangle(i);
+    }
+
+    for (auto &e : horizon) {
+      add_triangle(e.first, e.second, index);
+    }
+  }
+
+  //
+  // Remove point index from the hull leaving it isolated
+  //
+  void detach(int index)
+  {
+    std::vector<int> star = incident[index];
+    std::vector<int> link;
+
+    for (auto t : star) {
+      for (int k = 0; k < 3; k ++) {
+	int j = triangles[t].v[k];
+	if (j != index && std::find(link.begin(), link.end(), j) == link.end()) {
+	  link.push_back(j);
+	}
+      }
+    }
+
+    int nlink = (int)link.size();
+    if (nlink < 3 || (int)star.size() != nlink) {
+      valid = false;
+      return;
+    }
+
+    //
+    // Faces of the hull of the link visible from the removed point fill the hole
+    //
+    const vector_t &p = points[index];
+    std::vector<int> fill;
+
+    for (int i = 0; i < nlink; i ++) {
+      for (int j = i + 1; j < nlink; j ++) {
+	for (int l = j + 1; l < nlink; l ++) {
+
+	  const vector_t &a = points[link[i]];
+	  vector_t normal = cross(points[link[j]] - a, points[link[l]] - a);
+	  value offset = normal.dot(a);
+
+	  int above = 0;
+	  int below = 0;
+	  for (int m = 0; m < nlink; m ++) {
+	    if (m != i && m != j && m != l) {
+	      value s = normal.dot(points[link[m]]) - offset;
+	      if (s > EPSILON) {
+		above ++;
+	      } else if (s < -EPSILON) {
+		below ++;
+	      }
+	    }
+	  }
+
+	  if (above > 0 && below > 0) {
+	    continue;
+	  }
+
+	  value s = normal.dot(p) - offset;
+	  if (above > 0 || (below == 0 && s < 0.0)) {
+	    //
+	    // Orient so that the remaining link points are below
+	    //
+	    s = -s;
+	    fill.push_back(link[i]);
+	    fill.push_back(link[l]);
+	    fill.push_back(link[j]);
+	  } else {
+	    fill.push_back(link[i]);
+	    fill.push_back(link[j]);
+	    fill.push_back(link[l]);
+	  }
+
+	  if (s <= EPSILON) {
+	    fill.resize(fill.size() - 3);
+	  }
+	}
+      }
+    }
+
+    if ((int)fill.size() != 3 * (nlink - 2)) {
+      valid = false;
+      return;
+    }
+
+    for (auto t : star) {
+      remove_triangle(t);
+    }
+
+    for (int i = 0; i < (int)fill.size(); i += 3) {
+      add_triangle(fill[i], fill[i + 1], fill[i + 2]);
+    }
+  }
+
+  void rebuild()
+  {
+    int n = (int)points.size();
+
+    triangles.clear();
+    freelist.clear();
+    incident.assign(n, std::vector<int>());
+    valid = false;
+
+    if (n < 4) {
+      return;
+    }
+
+    //
+    // Initial tetrahedron from the first 4 points in general position
+    //
+    int b = -1;
+    for (int i = 1; i < n && b < 0; i ++) {
+      if ((points[i] - points[0]).length() > EPSILON) {
+	b = i;
+      }
+    }
+    if (b < 0) {
+      return;
+    }
+
+    int c = -1;
+    for (int i = b + 1; i < n && c < 0; i ++) {
+      if (cross(points[b] - points[0], points[i] - points[0]).length() > EPSILON) {
+	c = i;
+      }
+    }
+    if (c < 0) {
+      return;
+    }
+
+    vector_t normal = cross(points[b] - points[0], points[c] - points[0]);
+    value offset = normal.dot(points[0]);
+    int d = -1;
+    for (int i = c + 1; i < n && d < 0; i ++) {
+      value s = normal.dot(points[i]) - offset;
+      if (s > EPSILON || s < -EPSILON) {
+	d = i;
+      }
+    }
+    if (d < 0) {
+      return;
+    }
+
+    if (normal.dot(points[d]) - offset > 0.0) {
+      std::swap(b, c);
+    }
+
+    add_triangle(0, b, c);
+    add_triangle(0, d, b);
+    add_triangle(0, c, d);
+    add_triangle(b, d, c);
+    valid = true;
+
+    for (int i = 1; i < n && valid; i ++) {
+      if (i != b && i != c && i != d) {
+	attach(i);
+      }
+    }
+  }
+
+  std::vector<vector_t> points;
+  std::vector<std::vector<int>> incident;
+  std::vector<triangle_t> triangles;
+  std::vector<int> freelist;
+  bool valid;
+};
+
+#endif // sphericaldelaunay_hpp
@@ -23,6 +23,7 @@
 //
 
 #include <string.h>
+#include <algorithm>
 #include <math.h>
 
 #include "sphericalprior.hpp"
@@ -52,16 +53,6 @@ static void rotatefrompole(double phipole,
 
 double vonMisesPhi(double u, double kappa);
 
-static double
-newtonsolve(double (*f)(void *user, double x),
-	    double (*fprime)(void *user, double x),
-	    double xmin,
-	    double xmax,
-	    double y,
-	    double threshold,
-	    int maxsteps,
-	    void *user);
-
 SphericalPrior::SphericalPrior()
 {
 }
@@ -126,6 +117,17 @@ SphericalProposal::get_prior()
   return &prior;
 }
 
+double
+SphericalProposal::get_scale()
+{
+  return 0.0;
+}
+
+void
+SphericalProposal::set_scale(double scale)
+{
+}
+
 SphericalProposal*
 SphericalProposal::load(FILE *fp, SphericalPrior &prior)
 {
@@ -311,8 +313,10 @@ CosineSphericalPrior::CosineSphericalPrior(double _phi0,
 					   double _delta) :
   phi0(_phi0),
   theta0(_theta0),
-  delta(_delta)
+  delta(_delta),
+  lognormalisation(-log(delta * 2.0 * M_PI))
 {
+  table.build(cdf, polarpdf, this, 0.0, delta);
 }
 
 CosineSphericalPrior::~CosineSphericalPrior()
@@ -328,33 +332,7 @@ CosineSphericalPrior::valid(double phi, double theta)
 void
 CosineSphericalPrior::sample(Rng &rng, double &phi, double &theta)
 {
-  //
-  // PDF is (cos(phi * M_PI/delta) + 1)/delta
-  // CDF is (phi/delta + 1/M_PI*sin(phi * M_PI/delta)
-  //
-  // Can generate uniform t and then use newton method to find root of CDF - t
-  //
-  auto cdf = [](void *user, double x) -> double {
-    double delta = ((CosineSphericalPrior*)user)->delta;
-    return (sin(M_PI * x/delta)/M_PI + x/delta);
-  };
-  
-  auto pdf = [](void *user, double x) -> double {
-    double delta = ((CosineSphericalPrior*)user)->delta;
-    return ((cos(M_PI * x/delta) + 1.0)/delta);
-  };
-
-  double u = rng.uniform();
-
-  double phipole = newtonsolve(cdf,
-			       pdf,
-			       0.0,
-			       delta,
-			       u,
-			       1.0e-9,
-			       1000,
-			       this);
-
+  double phipole = table.sample(rng.uniform());
   double thetapole = rng.uniform() * 2.0 * M_PI;
 
   rotatefrompole(phipole, thetapole, phi0, theta0, phi, theta);
@@ -375,11 +353,29 @@ CosineSphericalPrior::pdf(double phi, double theta)
 double
 CosineSphericalPrior::logpdf(double phi, double theta)
 {
-  double p = pdf(phi, theta);
-  if (p > 0.0) {
-    return log(p);
+  double d = distance(phi0, theta0, phi, theta);
+
+  if (d < delta) {
+    return log(cos(d * M_PI/delta) + 1.0) + lognormalisation;
   }
-  return p;
+  return 0.0;
+}
+
+//
+// Distribution of the distance from the centre, the PDF is (cos(x * M_PI/delta) + 1)/delta
+//
+double
+CosineSphericalPrior::cdf(void *user, double x)
+{
+  double delta = ((CosineSphericalPrior*)user)->delta;
+  return (sin(M_PI * x/delta)/M_PI + x/delta);
+}
+
+double
+CosineSphericalPrior::polarpdf(void *user, double x)
+{
+  double delta = ((CosineSphericalPrior*)user)->delta;
+  return ((cos(M_PI * x/delta) + 1.0)/delta);
 }
 
 SphericalPrior*
@@ -402,7 +398,9 @@ const bool VonMisesSphericalPrior::REGISTRATION = SphericalPrior::register_prior
 VonMisesSphericalPrior::VonMisesSphericalPrior(double _phi0, double _theta0, double _kappa) :
   phi0(_phi0),
   theta0(_theta0),
-  kappa(_kappa)
+  kappa(_kappa),
+  exp2kappa(exp(-2.0 * _kappa)),
+  lognormalisation(vonMisesLogNormalisation(_kappa))
 {
 }
 
@@ -419,7 +417,7 @@ VonMisesSphericalPrior::valid(double phi0, double theta0)
 void
 VonMisesSphericalPrior::sample(Rng &rng, double &phi, double &theta)
 {
-  double phipole = vonMisesPhi(rng.uniform(), kappa);
+  double phipole = vonMisesPhi(rng.uniform(), kappa, exp2kappa);
   double thetapole = 2.0 * M_PI * rng.uniform();
 
   rotatefrompole(phipole, thetapole, phi0, theta0, phi, theta);
@@ -428,15 +426,15 @@ VonMisesSphericalPrior::sample(Rng &rng, double &phi, double &theta)
 double
 VonMisesSphericalPrior::pdf(double phi, double theta)
 {
-  double delta = distance(phi0, theta0, phi, theta);
-
-  return kappa/(4.0 * M_PI * sinh(kappa)) * exp(cos(delta) * kappa) * sin(delta);
+  return exp(logpdf(phi, theta));
 }
 
 double
 VonMisesSphericalPrior::logpdf(double phi, double theta)
 {
-  return log(pdf(phi, theta));
+  double delta = distance(phi0, theta0, phi, theta);
+
+  return lognormalisation + cos(delta) * kappa + log(sin(delta));
 }
 
 SphericalPrior*
@@ -518,9 +516,9 @@ PriorSampleSphericalProposal::read(FILE *fp, SphericalPrior &prior)
 const bool VonMisesSphericalProposal::REGISTRATION = SphericalProposal::register_spherical_proposal("VonMisesSpherical", VonMisesSphericalProposal::read);
 
 VonMisesSphericalProposal::VonMisesSphericalProposal(SphericalPrior &prior, double _kappa) :
-  SphericalProposal(prior),
-  kappa(_kappa)
+  SphericalProposal(prior)
 {
+  set_kappa(_kappa);
 }
 
 VonMisesSphericalProposal::~VonMisesSphericalProposal()
@@ -536,7 +534,7 @@ VonMisesSphericalProposal::propose(Rng &rng,
 				   double &newtheta,
 				   double &logpriorratio)
 {
-  double phipole = vonMisesPhi(rng.uniform(), kappa);
+  double phipole = vonMisesPhi(rng.uniform(), kappa, exp2kappa);
   double thetapole = 2.0 * M_PI * rng.uniform();
 
   rotatefrompole(phipole, thetapole, oldphi, oldtheta, newphi, newtheta);
@@ -561,7 +559,7 @@ VonMisesSphericalProposal::log_proposal(Rng &rng, double temperature,
 {
   double delta = distance(oldphi, oldtheta, newphi, newtheta);
 
-  return log(kappa/(4.0 * M_PI * sinh(kappa)) * exp(cos(delta) * kappa) * sin(delta));
+  return lognormalisation + cos(delta) * kappa + log(sin(delta));
 }
 
 double VonMisesSphericalProposal::log_proposal_ratio(Rng &rng,
@@ -574,6 +572,26 @@ double VonMisesSphericalProposal::log_proposal_ratio(Rng &rng,
   return 0.0;
 }
 
+double
+VonMisesSphericalProposal::get_scale()
+{
+  return 1.0/sqrt(kappa);
+}
+
+void
+VonMisesSphericalProposal::set_scale(double scale)
+{
+  set_kappa(1.0/(scale * scale));
+}
+
+void
+VonMisesSphericalProposal::set_kappa(double _kappa)
+{
+  kappa = _kappa;
+  exp2kappa = exp(-2.0 * kappa);
+  lognormalisation = vonMisesLogNormalisation(kappa);
+}
+
 SphericalProposal *
 VonMisesSphericalProposal::read(FILE *fp, SphericalPrior &prior)
 {
@@ -587,6 +605,185 @@ VonMisesSphericalProposal::read(FILE *fp, SphericalPrior &prior)
   return new VonMisesSphericalProposal(prior, kappa);
 }
 
+const bool ResidualMixtureSphericalProposal::REGISTRATION = SphericalProposal::register_spherical_proposal("ResidualMixtureSpherical", ResidualMixtureSphericalProposal::read);
+
+ResidualMixtureSphericalProposal::ResidualMixtureSphericalProposal(SphericalPrior &prior,
+								   int _bands,
+								   double _uniform_weight) :
+  SphericalProposal(prior),
+  bands(_bands),
+  sectors(2 * _bands),
+  uniform_weight(_uniform_weight)
+{
+  if (bands < 1) {
+    throw ATTENUATIONEXCEPTION("Invalid no. bands: %d\n", bands);
+  }
+
+  if (uniform_weight <= 0.0 || uniform_weight > 1.0) {
+    throw ATTENUATIONEXCEPTION("Uniform weight must be in (0, 1]: %f\n", uniform_weight);
+  }
+
+  mass.resize(bands * sectors);
+  cumulative.resize(bands * sectors);
+  logdensity.resize(bands * sectors);
+
+  clear();
+  build();
+}
+
+ResidualMixtureSphericalProposal::~ResidualMixtureSphericalProposal()
+{
+}
+
+bool
+ResidualMixtureSphericalProposal::propose(Rng &rng,
+					  double temperature,
+					  double oldphi,
+					  double oldtheta,
+					  double &newphi,
+					  double &newtheta,
+					  double &logpriorratio)
+{
+  double total = cumulative.back();
+  
+  if (total <= 0.0 || rng.uniform() < uniform_weight) {
+
+    newtheta = 2.0 * M_PI * rng.uniform();
+    newphi = acos(2.0 * rng.uniform() - 1.0);
+
+  } else {
+
+    int c = std::upper_bound(cumulative.begin(), cumulative.end(), total * rng.uniform()) -
+      cumulative.begin();
+    if (c >= (int)cumulative.size()) {
+      c = (int)cumulative.size() - 1;
+    }
+
+    int b = c / sectors;
+    int s = c % sectors;
+
+    double z = 1.0 - 2.0 * ((double)b + rng.uniform())/(double)bands;
+    if (z < -1.0) {
+      z = -1.0;
+    } else if (z > 1.0) {
+      z = 1.0;
+    }
+    
+    newphi = acos(z);
+    newtheta = 2.0 * M_PI * ((double)s + rng.uniform())/(double)sectors;
+  }
+
+  if (prior.valid(newphi, newtheta)) {
+    logpriorratio = prior.logpdf(newphi, newtheta) - prior.logpdf(oldphi, oldtheta);
+    return true;
+  }
+
+  return false;
+}
+
+double
+ResidualMixtureSphericalProposal::log_proposal(Rng &rng,
+					       double temperature,
+					       double oldphi,
+					       double oldtheta,
+					       double newphi,
+					       double newtheta)
+{
+  return logdensity[cell(newphi, newtheta)];
+}
+
+double
+ResidualMixtureSphericalProposal::log_proposal_ratio(Rng &rng,
+						     double temperature,
+						     double oldphi,
+						     double oldtheta,
+						     double newphi,
+						     double newtheta)
+{
+  return logdensity[cell(oldphi, oldtheta)] - logdensity[cell(newphi, newtheta)];
+}
+
+void
+ResidualMixtureSphericalProposal::clear()
+{
+  std::fill(mass.begin(), mass.end(), 0.0);
+}
+
+void
+ResidualMixtureSphericalProposal::add(double phi, double theta, double m)
+{
+  if (m > 0.0) {
+    mass[cell(phi, theta)] += m;
+  }
+}
+
+void
+ResidualMixtureSphericalProposal::build()
+{
+  double total = 0.0;
+  for (int i = 0; i < (int)mass.size(); i ++) {
+    total += mass[i];
+    cumulative[i] = total;
+  }
+
+  //
+  // Each cell has area 4 pi/ncells
+  //
+  double ncells = (double)mass.size();
+  for (int i = 0; i < (int)mass.size(); i ++) {
+    double d = uniform_weight;
+    if (total > 0.0) {
+      d += (1.0 - uniform_weight) * mass[i]/total * ncells;
+    } else {
+      d = 1.0;
+    }
+    
+    logdensity[i] = log(d/(4.0 * M_PI));
+  }
+}
+
+SphericalProposal *
+ResidualMixtureSphericalProposal::read(FILE *fp, SphericalPrior &prior)
+{
+  int bands;
+  double uniform_weight;
+
+  if (fscanf(fp, "%d %lf", &bands, &uniform_weight) != 2) {
+    ERROR("Failed to read parameters\n");
+    return nullptr;
+  }
+
+  if (bands < 1 || uniform_weight <= 0.0 || uniform_weight > 1.0) {
+    ERROR("Invalid parameters: bands %d uniform weight %f\n", bands, uniform_weight);
+    return nullptr;
+  }
+
+  return new ResidualMixtureSphericalProposal(prior, bands, uniform_weight);
+}
+
+int
+ResidualMixtureSphericalProposal::cell(double phi, double theta) const
+{
+  int b = (int)((1.0 - cos(phi))/2.0 * (double)bands);
+  if (b < 0) {
+    b = 0;
+  } else if (b >= bands) {
+    b = bands - 1;
+  }
+
+  double t = fmod(theta, 2.0 * M_PI);
+  if (t < 0.0) {
+    t += 2.0 * M_PI;
+  }
+  
+  int s = (int)(t/(2.0 * M_PI) * (double)sectors);
+  if (s >= sectors) {
+    s = sectors - 1;
+  }
+
+  return b * sectors + s;
+}
+
 //
 // Helper functions
 //
@@ -646,9 +843,14 @@ static void rotatefrompole(double phipole,   // Coordinates of point with pole a
 }
 
 double vonMisesPhi(double u, double kappa)
+{
+  return vonMisesPhi(u, kappa, exp(-2.0 * kappa));
+}
+
+double vonMisesPhi(double u, double kappa, double exp2kappa)
 {
   if (kappa > 0.0) {
-    return acos(1.0 + log(u + (1.0 - u)*exp(-2.0 * kappa))/kappa);
+    return acos(1.0 + log(u + (1.0 - u)*exp2kappa)/kappa);
   } else if (kappa == 0.0) {
     return acos(2.0 * u - 1.0);
   } else {
@@ -656,53 +858,18 @@ double vonMisesPhi(double u, double kappa)
   }
 }
 
-static double
-newtonsolve(double (*f)(void *user, double x),
-	    double (*fprime)(void *user, double x),
-	    double xmin,
-	    double xmax,
-	    double y,
-	    double threshold,
-	    int maxsteps,
-	    void *user)
+double vonMisesLogNormalisation(double kappa)
 {
-  double x = (xmin + xmax)/2.0;
-  double yt = f(user, x);
-  int i;
-
-  i = 0;
-  while ((i < maxsteps) && (fabs(yt - y) > threshold)) {
-
-    double g = fprime(user, x);
-    double dx;
-    
-    if (g == 0.0) {
-      //
-      // Since the cdf's should be monotonicly increasing, this should only happen at the boundaries
-      //
-      if (y < yt) {
-	dx = 1.0e-6;
-      } else {
-	dx = -1.0e-6;
-      }
-    } else {
-      dx = (y - yt)/g;
-    }
-
-    x += dx;
-    if (x < xmin) {
-      x = xmin + threshold;
-    }
-    if (x > xmax) {
-      x = xmax - threshold;
-    }
-
-    yt = f(user, x);
-
-    i ++;
+  if (kappa > 0.0) {
+    //
+    // kappa/(4 pi sinh(kappa)) = kappa/(2 pi exp(kappa) (1 - exp(-2 kappa)))
+    //
+    return log(kappa/(2.0 * M_PI)) - kappa - log1p(-exp(-2.0 * kappa));
+  } else if (kappa == 0.0) {
+    return -log(4.0 * M_PI);
+  } else {
+    throw ATTENUATIONEXCEPTION("kappa must be greater or equal to zero.");
   }
-
-  return x;
 }
 
 
@@ -28,8 +28,10 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "rng.hpp"
+#include "inversecdftable.hpp"
 
 class SphericalPrior {
 public:
@@ -87,6 +89,13 @@ public:
 				    double newphi,
 				    double newtheta) = 0;
 
+  //
+  // Angular width of the proposal for adaptive tuning, zero for proposals that have no
+  // width to tune in which case set_scale is ignored.
+  //
+  virtual double get_scale();
+  virtual void set_scale(double scale);
+
   static SphericalProposal* load(FILE *fp, SphericalPrior &prior);
 
   typedef SphericalProposal* (*spherical_proposal_reader_f)(FILE *fp, SphericalPrior &prior);
@@ -182,6 +191,12 @@ public:
   CosineSphericalPrior(double phi0, double theta0, double delta);
   ~CosineSphericalPrior();
 
+  //
+  // The table refers back to this instance
+  //
+  CosineSphericalPrior(const CosineSphericalPrior &) = delete;
+  CosineSphericalPrior &operator=(const CosineSphericalPrior &) = delete;
+
   virtual bool valid(double phi, double theta);
   
   virtual void sample(Rng &rng, double &phi, double &theta);
@@ -194,16 +209,32 @@ public:
   
 private:
 
+  static double cdf(void *user, double x);
+  static double polarpdf(void *user, double x);
+
   static const bool REGISTRATION;
 
   double phi0;
   double theta0;
   double delta;
+
+  double lognormalisation;
+  inversecdftable table;
   
 };
   
 extern double vonMisesPhi(double u, double kappa);
 
+//
+// As above with exp(-2 kappa) precomputed
+//
+extern double vonMisesPhi(double u, double kappa, double exp2kappa);
+
+//
+// Log of the normalisation kappa/(4 pi sinh(kappa)) without overflow for large kappa
+//
+extern double vonMisesLogNormalisation(double kappa);
+
 class VonMisesSphericalPrior : public SphericalPrior {
 public:
 
@@ -227,6 +258,9 @@ private:
   double phi0;
   double theta0;
   double kappa;
+
+  double exp2kappa;
+  double lognormalisation;
   
 };
   
@@ -297,14 +331,85 @@ public:
 				    double newphi,
 				    double newtheta);
 
+  //
+  // The width is taken as 1/sqrt(kappa), the approximate standard deviation of the angular
+  // distance for large kappa.
+  //
+  virtual double get_scale();
+  virtual void set_scale(double scale);
+
   static SphericalProposal *read(FILE *fp, SphericalPrior &prior);
 
 private:
 
+  void set_kappa(double kappa);
+
   static const bool REGISTRATION;
   
   double kappa;
 
+  double exp2kappa;
+  double lognormalisation;
+
+};
+
+//
+// Mixture of a uniform density and a piecewise constant density on an equal area grid
+// (bands uniform in cos(colatitude) by twice as many sectors in longitude) whose cell
+// masses are set from the data, eg the misfit of the paths crossing each cell, so that new
+// cells are proposed where the model fits the data poorly. The density does not depend on
+// the current position so it is also the exact reverse density for deaths. The masses are
+// initially zero, giving a uniform proposal, until set with clear/add/build.
+//
+class ResidualMixtureSphericalProposal : public SphericalProposal {
+public:
+
+  ResidualMixtureSphericalProposal(SphericalPrior &prior, int bands, double uniform_weight);
+  ~ResidualMixtureSphericalProposal();
+
+  virtual bool propose(Rng &rng,
+		       double temperature,
+		       double oldphi,
+		       double oldtheta,
+		       double &newphi,
+		       double &newtheta,
+		       double &logpriorratio);
+
+  virtual double log_proposal(Rng &rng, double temperature,
+			      double oldphi,
+			      double oldtheta,
+			      double newphi,
+			      double newtheta);
+
+  virtual double log_proposal_ratio(Rng &rng,
+				    double temperature,
+				    double oldphi,
+				    double oldtheta,
+				    double newphi,
+				    double newtheta);
+
+  void clear();
+
+  void add(double phi, double theta, double mass);
+
+  void build();
+
+  static SphericalProposal *read(FILE *fp, SphericalPrior &prior);
+
+private:
+
+  int cell(double phi, double theta) const;
+
+  static const bool REGISTRATION;
+
+  int bands;
+  int sectors;
+  double uniform_weight;
+
+  std::vector<double> mass;
+  std::vector<double> cumulative;
+  std::vector<double> logdensity;
+  
 };
   
 
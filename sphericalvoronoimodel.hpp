@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "coordinate.hpp"
+#include "sphericaldelaunay.hpp"
 
 extern "C" {
   #include "slog.h"
@@ -65,8 +66,34 @@ public:
     value v;
   } cell_t;
 
+  //
+  // Record of a change to the geometry of the tessellation
+  //
+  typedef enum {
+    EDIT_INSERT = 0,
+    EDIT_REMOVE,
+    EDIT_MOVE,
+    EDIT_RESET
+  } edit_kind_t;
+  
+  struct edit_t {
+    edit_t(edit_kind_t _kind, int _index, const coord_t &_c) :
+      kind(_kind),
+      index(_index),
+      c(_c)
+    {
+    }
+    
+    edit_kind_t kind;
+    int index;
+    coord_t c;
+  };
+
   sphericalvoronoimodel(bool _logspace) :
-    logspace(_logspace)
+    logspace(_logspace),
+    triangulated(false),
+    revision(0),
+    journalled(false)
   {
   }
   
@@ -77,6 +104,19 @@ public:
   void reset()
   {
     cells.clear();
+    delaunay.clear();
+    revision ++;
+    record(EDIT_RESET, 0, coord_t());
+  }
+
+  //
+  // Maintain the Delaunay triangulation of the cell centres through subsequent changes to
+  // the model for walk based point location and natural neighbour queries.
+  //
+  void enable_triangulation()
+  {
+    triangulated = true;
+    retriangulate();
   }
 
   int ncells() const
@@ -84,6 +124,46 @@ public:
     return cells.size();
   }
 
+  bool is_logspace() const
+  {
+    return logspace;
+  }
+
+  //
+  // Record geometry changes for consumers that maintain state derived from the tessellation
+  // incrementally, see take_journal.
+  //
+  void enable_journal()
+  {
+    journalled = true;
+    journal.clear();
+    record(EDIT_RESET, 0, coord_t());
+  }
+
+  void disable_journal()
+  {
+    journalled = false;
+    journal.clear();
+  }
+
+  //
+  // Move the geometry changes since the last call into edits
+  //
+  void take_journal(std::vector<edit_t> &edits)
+  {
+    edits.clear();
+    edits.swap(journal);
+  }
+
+  //
+  // Incremented whenever cells are added, removed or moved, ie when the geometry of the
+  // tessellation changes (but not the cell values).
+  //
+  int geometry_revision() const
+  {
+    return revision;
+  }
+
   void dump() const
   {
     int i = 0;
@@ -98,6 +178,13 @@ public:
   void add_cell(const coord_t &p, const value &v)
   {
     cells.push_back(cell_t(p, v));
+
+    if (triangulated) {
+      delaunay.insert(cells.size() - 1, unit(p));
+    }
+
+    revision ++;
+    record(EDIT_INSERT, cells.size() - 1, p);
   }
 
   void pop()
@@ -107,6 +194,13 @@ public:
     }
 
     cells.pop_back();
+
+    if (triangulated) {
+      delaunay.remove(cells.size());
+    }
+
+    revision ++;
+    record(EDIT_REMOVE, cells.size(), coord_t());
   }
 
   void delete_cell(int index)
@@ -116,6 +210,13 @@ public:
     }
 
     cells.erase(cells.begin() + index);
+
+    if (triangulated) {
+      delaunay.remove(index);
+    }
+
+    revision ++;
+    record(EDIT_REMOVE, index, coord_t());
   }
 
   void insert_cell(int index, const coord_t &p, const value &v)
@@ -125,6 +226,88 @@ public:
     }
 
     cells.insert(cells.begin() + index, cell_t(p, v));
+
+    if (triangulated) {
+      delaunay.insert(index, unit(p));
+    }
+
+    revision ++;
+    record(EDIT_INSERT, index, p);
+  }
+
+  //
+  // Cell centres must be moved with this rather than through get_cell_by_index/operator[]
+  // so that the triangulation is kept up to date.
+  //
+  void move_cell(int index, const coord_t &p)
+  {
+    if (index < 0 || index >= (int)cells.size()) {
+      throw ATTENUATIONEXCEPTION("Index out of range");
+    }
+
+    cells[index].c = p;
+
+    if (triangulated) {
+      delaunay.move(index, unit(p));
+    }
+
+    revision ++;
+    record(EDIT_MOVE, index, p);
+  }
+
+  //
+  // Natural neighbours of a cell, returns false if the triangulation is unavailable
+  //
+  bool neighbours(int index, std::vector<int> &nn) const
+  {
+    if (!triangulated || !delaunay.is_valid()) {
+      return false;
+    }
+
+    delaunay.neighbours(index, nn);
+    return true;
+  }
+
+  //
+  // Index of the nearest cell by exhaustive search
+  //
+  int nearest_index(const coord_t &p) const
+  {
+    if (cells.size() == 0) {
+      throw ATTENUATIONEXCEPTION("No nodes\n");
+    }
+
+    int nearest = 0;
+    value mindist = cells[0].distance(p);
+
+    for (int i = 1; i < (int)cells.size(); i ++) {
+
+      value d = cells[i].distance(p);
+      if (d < mindist) {
+	nearest = i;
+	mindist = d;
+      }
+    }
+
+    return nearest;
+  }
+
+  //
+  // Index of the nearest cell to a point given both in spherical coordinates and as a
+  // cartesian vector. When the triangulation is available the nearest cell is found by
+  // walking from the cell hint (negative for none), otherwise by exhaustive search.
+  //
+  int nearest_index(const coord_t &p, const vector3<value> &x, int hint) const
+  {
+    if (!triangulated || !delaunay.is_valid()) {
+      return nearest_index(p);
+    }
+
+    if (hint < 0 || hint >= (int)cells.size()) {
+      hint = 0;
+    }
+
+    return delaunay.nearest(x, hint);
   }
 
   void nearest(const coord_t &p, coord_t &cell_centre, value &cell_value) const
@@ -152,6 +335,38 @@ public:
     }
   }
 
+  //
+  // Cell centres as cartesian unit vectors with their values (exponentiated in log space)
+  // for forward models that work directly with the geometry of the tessellation.
+  //
+  void cartesian_cells(std::vector<vector3<value>> &centres, std::vector<value> &values) const
+  {
+    centres.resize(cells.size());
+    values.resize(cells.size());
+
+    for (int i = 0; i < (int)cells.size(); i ++) {
+      coord_t::sphericaltocartesian(cells[i].c.phi, cells[i].c.theta, centres[i]);
+
+      if (logspace) {
+	values[i] = exp(cells[i].v);
+      } else {
+	values[i] = cells[i].v;
+      }
+    }
+  }
+
+  //
+  // Value of a cell (exponentiated in log space)
+  //
+  value cell_value(int i) const
+  {
+    if (logspace) {
+      return exp(cells[i].v);
+    } else {
+      return cells[i].v;
+    }
+  }
+
   value value_at_point(const coord_t &p) const
   {
     coord_t centre;
@@ -162,6 +377,18 @@ public:
     return v;
   }
 
+  //
+  // Value at a point with the nearest cell located from hint, which is updated to the
+  // nearest cell. For consecutive points along a path the nearest cell is almost always the
+  // same or adjacent to the previous one.
+  //
+  value value_at_point(const coord_t &p, const vector3<value> &x, int &hint) const
+  {
+    hint = nearest_index(p, x, hint);
+
+    return cell_value(hint);
+  }
+
   cell_t *get_cell_by_index(size_t i)
   {
     if (i >= cells.size()) {
@@ -215,6 +442,8 @@ public:
     logspace = (bool)l;
 
     cells.clear();
+    revision ++;
+    record(EDIT_RESET, 0, coord_t());
     
     for (int i = 0; i < n; i ++) {
 
@@ -229,13 +458,51 @@ public:
     }
 
     fclose(fp);
+
+    if (triangulated) {
+      retriangulate();
+    }
+
     return true;
   }
 
 private:
+
+  static vector3<value> unit(const coord_t &p)
+  {
+    vector3<value> v;
+    coord_t::sphericaltocartesian(p.phi, p.theta, v);
+    return v;
+  }
+
+  void record(edit_kind_t kind, int index, const coord_t &p)
+  {
+    if (journalled) {
+      journal.push_back(edit_t(kind, index, p));
+    }
+  }
+
+  void retriangulate()
+  {
+    std::vector<vector3<value>> centres;
+    for (auto &c : cells) {
+      centres.push_back(unit(c.c));
+    }
+
+    delaunay.rebuild(centres);
+  }
+
   std::vector<cell_t> cells;
 
   bool logspace;
+
+  bool triangulated;
+  sphericaldelaunay<value> delaunay;
+
+  int revision;
+
+  bool journalled;
+  std::vector<edit_t> journal;
 };
 
 #endif //sphericalvoronoimodel_hpp
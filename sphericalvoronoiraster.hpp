@@ -0,0 +1,231 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+
+#pragma once
+#ifndef sphericalvoronoiraster_hpp
+#define sphericalvoronoiraster_hpp
+
+#include <math.h>
+
+#include <vector>
+
+#include "healpix.hpp"
+#include "sphericalvoronoimodel.hpp"
+
+//
+// Renders a spherical Voronoi model onto either a regular longitude/latitude image with
+// pixels ordered north to south then -180 .. 180 as in the post-processing tools, or a
+// HEALPix map in ring order.
+//
+// Both grids are made up of rows of pixels equally spaced around a circle of constant
+// colatitude. Along a row the boundary between cell i and a
+// neighbour j is where x.(cj - ci) = 0, ie R cos(theta - alpha) + C = 0, so the extent of a
+// cell along the row is found analytically from its natural neighbours and the pixels are
+// filled as runs. The nearest cell is only located (by walking the triangulation) at the
+// start of each run. The cell owning each pixel is cached and only recomputed when the
+// geometry of the model changes, otherwise only the values are updated.
+//
+// Requires the triangulation to be enabled on the model, otherwise each pixel is located
+// by exhaustive search.
+//
+template
+<
+  typename value
+>
+class sphericalvoronoiraster {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef vector3<value> vector_t;
+
+  sphericalvoronoiraster(int width, int height) :
+    npixels(width * height),
+    owner(width * height, 0),
+    last_model(nullptr),
+    last_revision(-1)
+  {
+    for (int j = 0; j < height; j ++) {
+      // North Pole to South Pole, -180 .. 180
+      rows.push_back(row_t(((value)j + 0.5)/(value)height * M_PI,
+			   -M_PI + M_PI/(value)width,
+			   width,
+			   j * width));
+    }
+  }
+
+  sphericalvoronoiraster(const healpix &grid) :
+    npixels(grid.npixels()),
+    owner(grid.npixels(), 0),
+    last_model(nullptr),
+    last_revision(-1)
+  {
+    for (int r = 1; r <= grid.nrings(); r ++) {
+      double phi, theta0;
+      int n, first;
+      
+      grid.ring(r, phi, theta0, n, first);
+      rows.push_back(row_t(phi, theta0, n, first));
+    }
+  }
+
+  void render(const sphericalvoronoimodel<value> &model, value *image)
+  {
+    model.cartesian_cells(centres, values);
+
+    if (&model != last_model || model.geometry_revision() != last_revision) {
+      rasterise(model);
+      
+      last_model = &model;
+      last_revision = model.geometry_revision();
+    }
+
+    for (int i = 0; i < npixels; i ++) {
+      image[i] = values[owner[i]];
+    }
+  }
+
+private:
+
+  struct row_t {
+    row_t(value _phi, value _theta0, int _n, int _first) :
+      phi(_phi),
+      theta0(_theta0),
+      n(_n),
+      first(_first)
+    {
+    }
+
+    value phi;
+    value theta0;
+    int n;
+    int first;
+  };
+
+  void rasterise(const sphericalvoronoimodel<value> &model)
+  {
+    int n = model.ncells();
+    bool runs = true;
+
+    adjacency.resize(n);
+    for (int i = 0; i < n && runs; i ++) {
+      runs = model.neighbours(i, adjacency[i]);
+    }
+
+    int rowstart = -1;
+    
+    for (auto &row : rows) {
+
+      value phi = row.phi;
+      value s = sin(phi);
+      value c = cos(phi);
+
+      int cell = rowstart;
+      value exit = row.theta0 - 2.0 * M_PI;
+      
+      for (int i = 0; i < row.n; i ++) {
+
+	value theta = row.theta0 + (value)i * 2.0 * M_PI/(value)row.n;
+
+	if (theta >= exit) {
+	  vector_t x(s * cos(theta), s * sin(theta), c);
+	  
+	  cell = model.nearest_index(coord_t(phi, theta), x, cell);
+	  if (i == 0) {
+	    rowstart = cell;
+	  }
+
+	  if (runs) {
+	    exit = theta + run_length(cell, s, c, theta);
+	  } else {
+	    exit = theta;
+	  }
+	}
+
+	owner[row.first + i] = cell;
+      }
+    }
+  }
+
+  //
+  // Distance in longitude from theta0 to where the row leaves cell i
+  //
+  value run_length(int i, value s, value c, value theta0) const
+  {
+    value length = 2.0 * M_PI;
+    const vector_t &ci = centres[i];
+
+    for (auto j : adjacency[i]) {
+      vector_t d = centres[j] - ci;
+
+      value R = s * sqrt(d.x * d.x + d.y * d.y);
+      value C = c * d.z;
+
+      if (R <= 0.0 || -C >= R) {
+	//
+	// Never nearer than cell i along this row
+	//
+	continue;
+      }
+
+      if (C >= R) {
+	//
+	// Always at least as near, only possible by round off
+	//
+	return 0.0;
+      }
+
+      //
+      // Where the bisector is crossed into cell j
+      //
+      value t = atan2(d.y, d.x) - acos(-C/R);
+      value delta = fmod(t - theta0, 2.0 * M_PI);
+      if (delta < 0.0) {
+	delta += 2.0 * M_PI;
+      }
+      if (delta > 2.0 * M_PI - 1.0e-9) {
+	delta = 0.0;
+      }
+
+      if (delta < length) {
+	length = delta;
+      }
+    }
+
+    return length;
+  }
+
+  int npixels;
+  std::vector<row_t> rows;
+  std::vector<int> owner;
+
+  const sphericalvoronoimodel<value> *last_model;
+  int last_revision;
+
+  std::vector<vector_t> centres;
+  std::vector<value> values;
+  std::vector<std::vector<int>> adjacency;
+};
+
+#endif // sphericalvoronoiraster_hpp
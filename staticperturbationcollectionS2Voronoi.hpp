@@ -0,0 +1,501 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#pragma once
+#ifndef staticperturbationcollectionS2Voronoi_hpp
+#define staticperturbationcollectionS2Voronoi_hpp
+
+#include <tuple>
+
+#include "globalS2Voronoi.hpp"
+#include "chainhistoryVoronoi.hpp"
+#include "perturbationS2Voronoi.hpp"
+#include "aliastable.hpp"
+#include "instrumentation.hpp"
+
+//
+// Calls f(std::get<i>(t), i) for the run time index i (visit) or for every element in order
+// (each) with the element's concrete type known at compile time.
+//
+template
+<int I, int N>
+struct staticdispatchS2Voronoi {
+
+  template
+  <typename tuple, typename F>
+  static void visit(tuple &t, int i, F &f)
+  {
+    if (i == I) {
+      f(std::get<I>(t), I);
+    } else {
+      staticdispatchS2Voronoi<I + 1, N>::visit(t, i, f);
+    }
+  }
+
+  template
+  <typename tuple, typename F>
+  static void each(tuple &t, F &f)
+  {
+    f(std::get<I>(t), I);
+    staticdispatchS2Voronoi<I + 1, N>::each(t, f);
+  }
+  
+};
+
+template
+<int N>
+struct staticdispatchS2Voronoi<N, N> {
+
+  template
+  <typename tuple, typename F>
+  static void visit(tuple &t, int i, F &f)
+  {
+    throw ATTENUATIONEXCEPTION("Invalid perturbation index %d (%d)\n", i, N);
+  }
+
+  template
+  <typename tuple, typename F>
+  static void each(tuple &t, F &f)
+  {
+  }
+  
+};
+
+//
+// As PerturbationCollectionS2Voronoi for a set of perturbations fixed at compile time. The
+// perturbations are held by value in a tuple and each call is dispatched on the index of the
+// active perturbation to its concrete type, without virtual calls, so that the work of an
+// iteration can be inlined into the chain loop. The weights are given in the order of the
+// perturbation types, eg
+//
+//   StaticPerturbationCollectionS2Voronoi<double,
+//                                         ValueS2Voronoi<double>,
+//                                         MoveS2Voronoi<double>> pc({1.0, 0.5},
+//                                                                   ValueS2Voronoi<double>(),
+//                                                                   MoveS2Voronoi<double>());
+//
+template
+<typename value, typename... perturbation_types>
+class StaticPerturbationCollectionS2Voronoi {
+public:
+
+  typedef sphericalcoordinate<value> coord_t;
+  typedef deltaVoronoi<coord_t, value> delta_t;
+  typedef std::tuple<perturbation_types...> tuple_t;
+  typedef staticdispatchS2Voronoi<0, sizeof...(perturbation_types)> dispatch_t;
+
+  static const int NPERTURBATIONS = sizeof...(perturbation_types);
+
+  StaticPerturbationCollectionS2Voronoi(const std::vector<double> &weights,
+					const perturbation_types&... _perturbations) :
+    communicator(MPI_COMM_NULL),
+    rank(-1),
+    size(-1),
+    perturbations(_perturbations...),
+    active(-1),
+    last(-1),
+    adaptations(0)
+  {
+    if ((int)weights.size() != NPERTURBATIONS) {
+      throw ATTENUATIONEXCEPTION("Mismatched weights %d (%d)\n", (int)weights.size(), NPERTURBATIONS);
+    }
+    
+    selection.build(weights);
+
+    for (int i = 0; i < NPERTURBATIONS; i ++) {
+      adapted_proposals[i] = 0;
+      adapted_acceptances[i] = 0;
+    }
+  }
+
+  void initialize_mpi(MPI_Comm _communicator)
+  {
+    MPI_Comm_dup(_communicator, &communicator);
+    MPI_Comm_rank(communicator, &rank);
+    MPI_Comm_size(communicator, &size);
+  }
+
+  template
+  <int I>
+  typename std::tuple_element<I, tuple_t>::type &get()
+  {
+    return std::get<I>(perturbations);
+  }
+
+  bool propose(globalS2Voronoi<value> &g, double &log_prior_ratio, delta_t *&perturbation)
+  {
+    if (active >= 0) {
+      throw ATTENUATIONEXCEPTION("Already have active perturbation\n");
+    }
+    
+    if (primary()) {
+      active = selection.sample(g.random.uniform());
+    }
+
+    communicate(active);
+    last = active;
+    
+    propose_f f(g, log_prior_ratio, perturbation);
+    dispatch_t::visit(perturbations, active, f);
+    
+    if (!f.r) {
+      active = -1;
+    }
+    
+    return f.r;
+  }
+
+  double log_proposal_ratio(globalS2Voronoi<value> &g) 
+  {
+    log_proposal_ratio_f f(g);
+    dispatch_t::visit(perturbations, active, f);
+    return f.r;
+  }
+
+  void accept(globalS2Voronoi<value> &g)
+  {
+    accept_f f;
+    dispatch_t::visit(perturbations, active, f);
+    
+    active = -1;
+  }
+  
+  void reject(globalS2Voronoi<value> &g)
+  {
+    reject_f f(g);
+    dispatch_t::visit(perturbations, active, f);
+    
+    active = -1;
+  }
+
+  void discard(globalS2Voronoi<value> &g)
+  {
+    discard_f f(g, active >= 0);
+    dispatch_t::visit(perturbations, last, f);
+
+    active = -1;
+  }
+
+  //
+  // See PerturbationCollectionS2Voronoi::adapt
+  //
+  void adapt(globalS2Voronoi<value> &g, double target)
+  {
+    adaptations ++;
+
+    adapt_f f(*this, g, target, 1.0/sqrt((double)adaptations));
+    dispatch_t::each(perturbations, f);
+  }
+
+  void adaptation(globalS2Voronoi<value> &g,
+		  std::vector<std::string> &names,
+		  std::vector<double> &scales)
+  {
+    names.clear();
+    scales.clear();
+
+    adaptation_f f(g, names, scales);
+    dispatch_t::each(perturbations, f);
+  }
+
+  std::string generateadaptationreport(globalS2Voronoi<value> &g)
+  {
+    std::vector<std::string> names;
+    std::vector<double> scales;
+    std::string s;
+    char linebuffer[1024];
+
+    adaptation(g, names, scales);
+    for (int i = 0; i < (int)names.size(); i ++) {
+      sprintf(linebuffer, "  %12s: %12.6g\n", names[i].c_str(), scales[i]);
+      s += linebuffer;
+    }
+
+    return s;
+  }
+
+  void writeacceptancereport(FILE *fp)
+  {
+    fprintf(fp, "%s", generateacceptancereport().c_str());
+  }
+
+  std::string generateacceptancereport()
+  {
+    report_f f;
+    dispatch_t::each(perturbations, f);
+    return f.s;
+  }
+
+private:
+
+  bool primary()
+  {
+    return (communicator == MPI_COMM_NULL) || (rank == 0);
+  }
+
+  void communicate(int &i)
+  {
+    if (communicator != MPI_COMM_NULL) {
+      INSTRUMENT_START(COLLECTIVE);
+      MPI_Bcast(&i, 1, MPI_INT, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
+    }
+  }
+
+  void communicate(double &d)
+  {
+    if (communicator != MPI_COMM_NULL) {
+      INSTRUMENT_START(COLLECTIVE);
+      MPI_Bcast(&d, 1, MPI_DOUBLE, 0, communicator);
+      INSTRUMENT_END(COLLECTIVE);
+    }
+  }
+
+  static const int MINIMUM_ADAPTATION_PROPOSALS = 20;
+
+  //
+  // The operations on a single perturbation. The calls are qualified with the concrete type
+  // so that they are bound statically.
+  //
+  struct propose_f {
+    propose_f(globalS2Voronoi<value> &_g, double &_log_prior_ratio, delta_t *&_perturbation) :
+      g(_g),
+      log_prior_ratio(_log_prior_ratio),
+      perturbation(_perturbation),
+      r(false)
+    {
+    }
+
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      int nobs = 0;
+      if (g.data != nullptr) {
+	nobs = g.data->data.size();
+      }
+
+      INSTRUMENT_CATEGORY(p.P::displayname());
+
+      INSTRUMENT_START(PROPOSE);
+      r = p.P::propose(g.maxcells,
+		       nobs,
+		       g.random,
+		       *g.prior,
+		       *g.positionprior,
+		       *g.model,
+		       *g.hierarchicalprior,
+		       *g.hierarchical,
+		       g.temperature,
+		       log_prior_ratio,
+		       perturbation);
+      INSTRUMENT_END(PROPOSE);
+    }
+    
+    globalS2Voronoi<value> &g;
+    double &log_prior_ratio;
+    delta_t *&perturbation;
+    bool r;
+  };
+
+  struct log_proposal_ratio_f {
+    log_proposal_ratio_f(globalS2Voronoi<value> &_g) :
+      g(_g),
+      r(0.0)
+    {
+    }
+
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      r = p.P::log_proposal_ratio(g.random,
+				  *g.prior,
+				  *g.positionprior,
+				  *g.model,
+				  *g.hierarchicalprior,
+				  *g.hierarchical,
+				  1.0);
+    }
+
+    globalS2Voronoi<value> &g;
+    double r;
+  };
+
+  struct accept_f {
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      p.P::accept();
+    }
+  };
+
+  struct reject_f {
+    reject_f(globalS2Voronoi<value> &_g) :
+      g(_g)
+    {
+    }
+
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      p.P::reject(*g.model);
+    }
+
+    globalS2Voronoi<value> &g;
+  };
+
+  struct discard_f {
+    discard_f(globalS2Voronoi<value> &_g, bool _valid) :
+      g(_g),
+      valid(_valid)
+    {
+    }
+
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      if (valid) {
+	p.P::reject(*g.model);
+      }
+      p.discard(*g.model, false);
+    }
+
+    globalS2Voronoi<value> &g;
+    bool valid;
+  };
+
+  struct adapt_f {
+    adapt_f(StaticPerturbationCollectionS2Voronoi &_c,
+	    globalS2Voronoi<value> &_g,
+	    double _target,
+	    double _gain) :
+      c(_c),
+      g(_g),
+      target(_target),
+      gain(_gain)
+    {
+    }
+
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      double scale = p.P::get_scale(*g.prior, *g.positionprior, *g.hierarchicalprior);
+      if (scale <= 0.0) {
+	return;
+      }
+
+      if (c.primary()) {
+	int np = p.P::proposal_count() - p.discard_count();
+	int na = p.P::acceptance_count();
+
+	int dp = np - c.adapted_proposals[i];
+	if (dp >= MINIMUM_ADAPTATION_PROPOSALS) {
+	  double rate = (double)(na - c.adapted_acceptances[i])/(double)dp;
+	  
+	  scale *= exp(gain * (rate - target));
+
+	  c.adapted_proposals[i] = np;
+	  c.adapted_acceptances[i] = na;
+	}
+      }
+
+      c.communicate(scale);
+      p.P::set_scale(*g.prior, *g.positionprior, *g.hierarchicalprior, scale);
+    }
+
+    StaticPerturbationCollectionS2Voronoi &c;
+    globalS2Voronoi<value> &g;
+    double target;
+    double gain;
+  };
+
+  struct adaptation_f {
+    adaptation_f(globalS2Voronoi<value> &_g,
+		 std::vector<std::string> &_names,
+		 std::vector<double> &_scales) :
+      g(_g),
+      names(_names),
+      scales(_scales)
+    {
+    }
+
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      double scale = p.P::get_scale(*g.prior, *g.positionprior, *g.hierarchicalprior);
+      if (scale > 0.0) {
+	names.push_back(p.P::displayname());
+	scales.push_back(scale);
+      }
+    }
+
+    globalS2Voronoi<value> &g;
+    std::vector<std::string> &names;
+    std::vector<double> &scales;
+  };
+
+  struct report_f {
+    template
+    <typename P>
+    void operator()(P &p, int i)
+    {
+      char linebuffer[1024];
+      
+      int np = p.P::proposal_count() - p.discard_count();
+      int na = p.P::acceptance_count();
+      
+      double f = 0.0;
+      if (np > 0) {
+	f = (double)na/(double)np * 100.0;
+      }
+      
+      sprintf(linebuffer, "  %12s: %6d %6d : %6.2f\n", p.P::displayname(), np, na, f);
+      s += linebuffer;
+    }
+
+    std::string s;
+  };
+
+  MPI_Comm communicator;
+  int rank;
+  int size;
+  
+  aliastable selection;
+  tuple_t perturbations;
+  int active;
+  int last;
+
+  int adaptations;
+  int adapted_proposals[sizeof...(perturbation_types)];
+  int adapted_acceptances[sizeof...(perturbation_types)];
+
+};
+
+#endif // staticperturbationcollectionS2Voronoi_hpp
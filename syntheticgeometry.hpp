@@ -0,0 +1,111 @@
+//
+//    AttenuationVoronoi : A software used in a study of the attenuation of the Earths
+//    inner core, see 
+//
+//      Pejic T., Hawkins R., Sambridge M. & Tkalcic H. "Trans-dimensional Bayesian attenuation tomography 
+//      of the upper inner core", Journal of Geophysical Research, 2019, to appear.
+//    
+//    Copyright (C) 2014 - 2018 Rhys Hawkins
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//
+
+#pragma once
+#ifndef syntheticgeometry_hpp
+#define syntheticgeometry_hpp
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+
+#include "rng.hpp"
+
+//
+// Random ray paths through the upper inner core for benchmarks and scaling tests, written
+// in the observation file format (t*, noise and no. points followed by lon, lat and radius
+// of each point). Each path is a straight chord between two points on the inner core
+// boundary a random arc apart, from a uniformly distributed start point in a uniformly
+// distributed direction, sampled at equally spaced angles along the great circle beneath
+// it. The t* values are as given, eg placeholders to be recomputed from a synthetic model
+// with mksynthetic.
+//
+class syntheticgeometry {
+public:
+
+  static constexpr double INNER_CORE_RADIUS = 1221.0;
+  static constexpr double MINIMUM_ARC = 10.0;
+  static constexpr double MAXIMUM_ARC = 30.0;
+  static const int DEFAULT_POINTS = 40;
+
+  static void path(Rng &random,
+		   int npoints,
+		   std::vector<double> &lon,
+		   std::vector<double> &lat,
+		   std::vector<double> &r)
+  {
+    double lat0 = asin(2.0 * random.uniform() - 1.0);
+    double lon0 = (2.0 * random.uniform() - 1.0) * M_PI;
+    double bearing = 2.0 * M_PI * random.uniform();
+    double arc = (MINIMUM_ARC + (MAXIMUM_ARC - MINIMUM_ARC) * random.uniform()) * M_PI/180.0;
+
+    lon.resize(npoints);
+    lat.resize(npoints);
+    r.resize(npoints);
+    
+    for (int i = 0; i < npoints; i ++) {
+      double alpha = arc * (double)i/(double)(npoints - 1);
+
+      double plat = asin(sin(lat0) * cos(alpha) + cos(lat0) * sin(alpha) * cos(bearing));
+      double plon = lon0 + atan2(sin(bearing) * sin(alpha) * cos(lat0),
+				 cos(alpha) - sin(lat0) * sin(plat));
+
+      lat[i] = plat * 180.0/M_PI;
+      lon[i] = atan2(sin(plon), cos(plon)) * 180.0/M_PI;
+      r[i] = INNER_CORE_RADIUS * cos(0.5 * arc)/cos(alpha - 0.5 * arc);
+    }
+  }
+
+  static bool write(const char *filename,
+		    const std::vector<double> &tstar,
+		    double noise,
+		    int npoints,
+		    Rng &random)
+  {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+      return false;
+    }
+
+    std::vector<double> lon;
+    std::vector<double> lat;
+    std::vector<double> r;
+
+    for (auto t : tstar) {
+      path(random, npoints, lon, lat, r);
+
+      fprintf(fp, "%.9g %.9g %d\n", t, noise, npoints);
+      for (int i = 0; i < npoints; i ++) {
+	fprintf(fp, "%15.9f %15.9f %15.9f\n", lon[i], lat[i], r[i]);
+      }
+    }
+
+    fclose(fp);
+    return true;
+  }
+
+};
+
+#endif // syntheticgeometry_hpp